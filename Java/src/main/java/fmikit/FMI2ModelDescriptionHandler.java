@@ -77,6 +77,9 @@ public class FMI2ModelDescriptionHandler extends ModelDescriptionHandler {
 				
 				sv.unit = attributes.getValue("unit");
 				
+				// 1-based index of the state variable
+				sv.derivative = attributes.getValue("derivative");
+				
 				String declaredType = attributes.getValue("declaredType");
 				
 				if (modelDescription.typeDefinitions.containsKey(declaredType)) {
@@ -113,6 +116,7 @@ public class FMI2ModelDescriptionHandler extends ModelDescriptionHandler {
 			
 			implementation = modelDescription.modelExchange = new ModelExchange();
 			modelDescription.modelExchange.modelIdentifier = attributes.getValue("modelIdentifier");
+			modelDescription.modelExchange.providesDirectionalDerivative = "true".equals(attributes.getValue("providesDirectionalDerivative"));
 			
 		} else if ("CoSimulation".equals(qName)) {
 			
@@ -7,9 +7,11 @@ package fmikit;
 
 public class ModelExchange extends Implementation {
 
+	public boolean providesDirectionalDerivative;
+
 	@Override
 	public String toString() {
 		return "ModelExchange {modelIdentifier: " + modelIdentifier + ", platforms: "
-				+ platforms + ", sourceFiles: " + sourceFiles + "}";
+				+ platforms + ", sourceFiles: " + sourceFiles + ", providesDirectionalDerivative: " + providesDirectionalDerivative + "}";
 	}
 }
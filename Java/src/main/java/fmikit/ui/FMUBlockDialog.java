@@ -994,6 +994,13 @@ public class FMUBlockDialog extends JDialog {
         // output port variable VRs
         params.add("[" + Util.join(outputPortVariableVRs, " ") + "]");
 
+        // continuous state VRs, derivative VRs and the sparsity pattern of the analytic Jacobian
+        if (isModelExchange && isFMI2 && modelDescription.modelExchange != null && modelDescription.modelExchange.providesDirectionalDerivative && modelDescription.numberOfContinuousStates > 0) {
+            addJacobianParameters(params, inputPorts, outputPorts);
+        } else {
+            params.addAll(Collections.nCopies(4, "[]"));
+        }
+
         // parameters
         for (ScalarVariable variable : modelDescription.scalarVariables) {
 
@@ -1023,6 +1030,97 @@ public class FMUBlockDialog extends JDialog {
         return Util.join(params, " ");
     }
 
+    /**
+     * Add the value references of the continuous states and derivatives and the sparsity pattern
+     * of the Jacobian d[der(x), y]/d[x, u, reset] in compressed sparse column format
+     */
+    private void addJacobianParameters(List<String> params, List<List<ScalarVariable>> inputPorts, List<List<ScalarVariable>> outputPorts) {
+
+        ArrayList<ScalarVariable> rows = new ArrayList<ScalarVariable>();
+        ArrayList<ScalarVariable> columns = new ArrayList<ScalarVariable>();
+        ArrayList<String> stateVRs = new ArrayList<String>();
+        ArrayList<String> derivativeVRs = new ArrayList<String>();
+
+        for (ScalarVariable derivative : modelDescription.modelStructure.derivatives.keySet()) {
+            ScalarVariable state = modelDescription.scalarVariables.get(Integer.parseInt(derivative.derivative) - 1);
+            rows.add(derivative);
+            columns.add(state);
+            derivativeVRs.add(derivative.valueReference);
+            stateVRs.add(state.valueReference);
+        }
+
+        for (List<ScalarVariable> outputPort : outputPorts) {
+            rows.addAll(outputPort);
+        }
+
+        for (List<ScalarVariable> inputPort : inputPorts) {
+            columns.addAll(inputPort);
+        }
+
+        ArrayList<Integer> ir = new ArrayList<Integer>();
+        ArrayList<Integer> jc = new ArrayList<Integer>();
+
+        jc.add(0);
+
+        for (ScalarVariable column : columns) {
+
+            for (int i = 0; i < rows.size(); i++) {
+
+                ScalarVariable row = rows.get(i);
+
+                if (!"Real".equals(row.type) || !"Real".equals(column.type)) {
+                    continue;
+                }
+
+                if (dependsOn(row, column)) {
+                    ir.add(i);
+                }
+            }
+
+            jc.add(ir.size());
+        }
+
+        // the reset input has no entries
+        if (resettableCheckBox.isSelected()) {
+            jc.add(ir.size());
+        }
+
+        params.add("[" + Util.join(stateVRs, " ") + "]");
+        params.add("[" + Util.join(derivativeVRs, " ") + "]");
+        params.add("[" + Util.join(ir, " ") + "]");
+        params.add("[" + Util.join(jc, " ") + "]");
+    }
+
+    /**
+     * Returns true if the variable may depend on the known variable according to the model structure
+     */
+    private boolean dependsOn(ScalarVariable variable, ScalarVariable known) {
+
+        ModelStructure modelStructure = modelDescription.modelStructure;
+
+        List<Dependency> dependencies;
+
+        if (modelStructure.derivatives.containsKey(variable)) {
+            dependencies = modelStructure.derivatives.get(variable);
+        } else if (modelStructure.outputs.containsKey(variable)) {
+            dependencies = modelStructure.outputs.get(variable);
+        } else {
+            return true;  // no information
+        }
+
+        if (dependencies == null) {
+            return true;  // depends on all states and inputs
+        }
+
+        for (Dependency dependency : dependencies) {
+            if (dependency.variable == known) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     /**
      * Calculate the variable size for an array variable in FMI 3.0
      */
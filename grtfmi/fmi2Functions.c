@@ -8,10 +8,23 @@
 #include <stdarg.h> /* for va_list */
 #include <stdio.h>  /* for vsnprintf(), vprintf() */
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h> /* for SRWLOCK */
+#else
+#include <pthread.h> /* for pthread_mutex_t */
+#endif
+
 #include "fmiwrapper.inc"
 
 #include "fmi2Functions.h"
 
+/* typed address of a model variable for the get / set fast path */
+typedef struct {
+	void *address; /* NULL if the variable is not of the type of the table */
+	size_t length; /* number of variables with consecutive value references that are stored contiguously from address */
+} VariableEntry;
+
 const char *RT_MEMORY_ALLOCATION_ERROR = "memory allocation error";
 
 /* Path to the resources directory of the extracted FMU */
@@ -23,26 +36,80 @@ typedef struct {
 	RT_MDL_P_T defaultParameters;
 #endif
 	const char* instanceName;
+	fmi2Type type;
 	fmi2CallbackLogger logger;
 	fmi2ComponentEnvironment componentEnvironment;
 	ModelVariable modelVariables[N_MODEL_VARIABLES];
+	VariableEntry realVariables[N_MODEL_VARIABLES];    /* SS_DOUBLE */
+	VariableEntry integerVariables[N_MODEL_VARIABLES]; /* SS_INT32 (enumerations are exported as SS_INT32 by grtfmilib.tlc) */
+	StateRegion stateRegions[N_STATE_REGIONS];
+#ifdef N_CONTINUOUS_STATES
+	/* Model Exchange and variable-step Co-Simulation */
+	fmi2Real time;
+	fmi2Real nextEventTime;
+	fmi2Boolean isDirtyValues;
+	fmi2Boolean isInitialized;
+	real_T derivatives[N_CONTINUOUS_STATES];
+	real_T savedStates[N_CONTINUOUS_STATES];
+#endif
+#ifdef VARIABLE_STEP_SOLVER
+	/* Dormand-Prince solver for Co-Simulation */
+	fmi2Real relativeTolerance;
+	fmi2Real stepSize;
+	real_T k[7][N_CONTINUOUS_STATES];
+#endif
 } ModelInstance;
 
-static ModelInstance *s_instance = NULL;
+/* FMU state: the contents of the state regions (8 byte aligned) without the pointers of the RT model
+   so it can be restored by any instance of the FMU (also after a reset or in another process) */
+typedef struct {
+	size_t size;
+#ifdef N_CONTINUOUS_STATES
+	fmi2Real time;
+	fmi2Real nextEventTime;
+#endif
+} ModelState;
+
+#define ALIGN_STATE(n) (((n) + 7) & ~(size_t)7)
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* number of instances (non-reusable models can only be instantiated once) */
+static int s_nInstances = 0;
+
+/* guards s_nInstances and FMU_RESOURCES_DIR against concurrent calls to fmi2Instantiate() and fmi2FreeInstance() */
+#ifdef _WIN32
+static SRWLOCK s_instancesLock = SRWLOCK_INIT;
+#define LOCK_INSTANCES   AcquireSRWLockExclusive(&s_instancesLock)
+#define UNLOCK_INSTANCES ReleaseSRWLockExclusive(&s_instancesLock)
+#else
+static pthread_mutex_t s_instancesLock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_INSTANCES   pthread_mutex_lock(&s_instancesLock)
+#define UNLOCK_INSTANCES pthread_mutex_unlock(&s_instancesLock)
+#endif
+
+/* instance that executes the model code on the current thread (for rtPrintfNoOp()) */
+static THREAD_LOCAL ModelInstance *s_activeInstance = NULL;
 
 #define ASSERT_INSTANCE \
-    if (!c || c != s_instance) { \
+    if (!c) { \
         return fmi2Error; \
-    }
+    } \
+    ModelInstance *instance = (ModelInstance *)c; \
+    s_activeInstance = instance;
 
 #define NOT_IMPLEMENTED \
-    logError("Function is not implemented."); \
+    logError((ModelInstance *)c, "Function is not implemented."); \
 	return fmi2Error;
 
 #define CHECK_ERROR_STATUS \
-	const char *errorStatus = rtmGetErrorStatus(s_instance->S); \
+	const char *errorStatus = rtmGetErrorStatus(instance->S); \
 	if (errorStatus) { \
-		logError(errorStatus); \
+		logError(instance, errorStatus); \
 		return fmi2Error; \
 	}
 
@@ -53,10 +120,10 @@ int rtPrintfNoOp(const char *fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
 
-	if (s_instance && s_instance->logger) {
+	if (s_activeInstance && s_activeInstance->logger) {
 		char message[1024] = "";
 		vsnprintf(message, 1024, fmt, args);
-        s_instance->logger(s_instance->componentEnvironment, s_instance->instanceName, fmi2OK, "info", message);
+        s_activeInstance->logger(s_activeInstance->componentEnvironment, s_activeInstance->instanceName, fmi2OK, "info", message);
 	} else {
 		vprintf(fmt, args);
 	}
@@ -66,9 +133,9 @@ int rtPrintfNoOp(const char *fmt, ...) {
 	return 0;
 }
 
-static void logError(const char *message) {
-    if (s_instance && s_instance->logger) {
-        s_instance->logger(s_instance->componentEnvironment, s_instance->instanceName, fmi2Error, "error", message);
+static void logError(ModelInstance *instance, const char *message) {
+    if (instance && instance->logger) {
+        instance->logger(instance->componentEnvironment, instance->instanceName, fmi2Error, "error", message);
     }
 }
 
@@ -77,12 +144,12 @@ static void doFixedStep(RT_MDL_TYPE *S) {
 #if NUM_TASKS > 1 // multitasking
 
 	// step the model for the base sample time
-	MODEL_STEP(0);
+	MODEL_STEP(S, 0);
 
 	// step the model for any other sample times (subrates)
 	for (int i = FIRST_TASK_ID + 1; i < NUM_SAMPLE_TIMES; i++) {
 		if (rtmStepTask(S, i)) {
-			MODEL_STEP(i);
+			MODEL_STEP(S, i);
 		}
 		if (++rtmTaskCounter(S, i) == rtmCounterLimit(S, i)) {
 			rtmTaskCounter(S, i) = 0;
@@ -91,8 +158,326 @@ static void doFixedStep(RT_MDL_TYPE *S) {
 
 #else // singletasking
 
-	MODEL_STEP();
+	MODEL_STEP(S);
+
+#endif
+}
+
+#ifdef N_CONTINUOUS_STATES
+#if defined(HAS_TASK_COUNTERS) && !defined(rtmTaskCounter)
+/* single-tasking models schedule the discrete rates with the same counters */
+#define rtmTaskCounter(S, i) ((S)->Timing.TaskCounters.TID[(i)])
+#endif
+
+/* number of base steps of a time on the grid of the fixed step size */
+#define BASE_STEPS(t) ((long)floor((t) / STEP_SIZE + 0.5))
+
+/* time of the first hit of a discrete sample time after the base step tick */
+static fmi2Real nextSampleHit(long tick) {
+
+#if N_DISCRETE_SAMPLE_TIMES > 0
+	long next = 0;
+
+	for (size_t i = 0; i < N_DISCRETE_SAMPLE_TIMES; i++) {
+
+		const long period = BASE_STEPS(discretePeriods[i]);
+		const long offset = BASE_STEPS(discreteOffsets[i]);
+		const long hit = tick < offset ? offset : tick + period - (tick - offset) % period;
+
+		if (i == 0 || hit < next) {
+			next = hit;
+		}
+	}
+
+	return next * STEP_SIZE;
+#else
+	UNUSED(tick);
+
+	return INFINITY;
+#endif
+}
+
+/* evaluate the outputs and derivatives at the current time and states in a minor time step */
+static void evaluateModel(ModelInstance *instance) {
+
+	RT_MDL_TYPE *S = instance->S;
+	RTWSolverInfo *si = &S->solverInfo;
+
+	/* not initialized yet */
+	if (!instance->isInitialized) {
+		return;
+	}
+
+	rtsiSetSimTimeStep(si, MINOR_TIME_STEP);
+	rtsiSetT(si, instance->time);
+
+#if NUM_TASKS > 1
+	MODEL_STEP(S, 0);
+#else
+	MODEL_STEP(S);
+#endif
+
+	/* the solver of the model redirects the derivatives to its work arrays */
+	rtsiSetdX(si, instance->derivatives);
+	MODEL_DERIVATIVES(S);
+
+	rtsiSetSimTimeStep(si, MAJOR_TIME_STEP);
+
+	instance->isDirtyValues = fmi2False;
+}
+
+/* update the discrete parts of the model in a major time step at a time event */
+static void doEventStep(ModelInstance *instance) {
+
+	RT_MDL_TYPE *S = instance->S;
+
+	const long tick = BASE_STEPS(instance->time);
+
+#ifdef HAS_TASK_COUNTERS
+	/* the base steps between the time events are skipped so the counters
+	   that schedule the discrete rates are set to the ones of this step */
+	for (size_t i = 0; i < N_DISCRETE_SAMPLE_TIMES; i++) {
 
+		const long period = BASE_STEPS(discretePeriods[i]);
+		const long offset = BASE_STEPS(discreteOffsets[i]);
+
+		if (period > 1) {
+			rtmTaskCounter(S, discreteTaskIDs[i]) = ((tick - offset) % period + period) % period;
+		}
+	}
+#endif
+
+	/* the continuous states belong to the importer and are restored after the
+	   step that also integrates them with the solver of the model */
+	memcpy(instance->savedStates, rtmGetContStates(S), sizeof(instance->savedStates));
+
+	rtsiSetT(&S->solverInfo, instance->time);
+
+	doFixedStep(S);
+
+	memcpy(rtmGetContStates(S), instance->savedStates, sizeof(instance->savedStates));
+
+	rtsiSetdX(&S->solverInfo, instance->derivatives);
+
+	instance->nextEventTime = nextSampleHit(tick);
+
+	instance->isDirtyValues = fmi2True;
+}
+#endif
+
+#ifdef VARIABLE_STEP_SOLVER
+/* Dormand-Prince 5(4) coefficients */
+static const double DP_C[7] = { 0, 1.0 / 5, 3.0 / 10, 4.0 / 5, 8.0 / 9, 1, 1 };
+
+static const double DP_A[7][6] = {
+	{ 0 },
+	{ 1.0 / 5 },
+	{ 3.0 / 40, 9.0 / 40 },
+	{ 44.0 / 45, -56.0 / 15, 32.0 / 9 },
+	{ 19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729 },
+	{ 9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656 },
+	{ 35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84 }
+};
+
+/* difference of the 5th and 4th order weights */
+static const double DP_E[7] = { 71.0 / 57600, 0, -71.0 / 16695, 71.0 / 1920, -17253.0 / 339200, 22.0 / 525, -1.0 / 40 };
+
+static void getDerivatives(ModelInstance *instance, fmi2Real time, real_T dx[]) {
+	instance->time = time;
+	evaluateModel(instance);
+	memcpy(dx, instance->derivatives, N_CONTINUOUS_STATES * sizeof(real_T));
+}
+
+/* integrate the continuous states from the current time to tEnd with error controlled steps */
+static fmi2Status integrate(ModelInstance *instance, fmi2Real tEnd) {
+
+	real_T *x = rtmGetContStates(instance->S);
+	real_T *x0 = instance->savedStates;
+	real_T (*k)[N_CONTINUOUS_STATES] = instance->k;
+
+	fmi2Real t = instance->time;
+	size_t i, j, s;
+
+	getDerivatives(instance, t, k[0]);
+
+	while (t < tEnd) {
+
+		fmi2Real h = instance->stepSize;
+
+		/* avoid a tiny last step */
+		const int isLastStep = t + 1.1 * h >= tEnd;
+
+		if (isLastStep) {
+			h = tEnd - t;
+		}
+
+		if (h < 1e-12 * (1 + fabs(t))) {
+			logError(instance, "The step size of the variable-step solver became too small.");
+			return fmi2Error;
+		}
+
+		memcpy(x0, x, N_CONTINUOUS_STATES * sizeof(real_T));
+
+		for (s = 1; s < 7; s++) {
+
+			for (i = 0; i < N_CONTINUOUS_STATES; i++) {
+
+				real_T dx = 0;
+
+				for (j = 0; j < s; j++) {
+					dx += DP_A[s][j] * k[j][i];
+				}
+
+				x[i] = x0[i] + h * dx;
+			}
+
+			getDerivatives(instance, t + DP_C[s] * h, k[s]);
+
+			CHECK_ERROR_STATUS
+		}
+
+		/* error of the embedded 4th order solution */
+		double error = 0;
+
+		for (i = 0; i < N_CONTINUOUS_STATES; i++) {
+
+			real_T e = 0;
+
+			for (s = 0; s < 7; s++) {
+				e += DP_E[s] * k[s][i];
+			}
+
+			const double scale = instance->relativeTolerance * (1 + fmax(fabs(x0[i]), fabs(x[i])));
+			const double ratio = fabs(h * e) / scale;
+
+			if (ratio > error) {
+				error = ratio;
+			}
+		}
+
+		const double factor = error > 0 ? 0.9 * pow(error, -0.2) : 5;
+
+		if (error <= 1) {
+			/* first same as last */
+			t = isLastStep ? tEnd : t + h;
+			memcpy(k[0], k[6], N_CONTINUOUS_STATES * sizeof(real_T));
+			instance->stepSize = h * fmin(5, factor);
+		} else {
+			memcpy(x, x0, N_CONTINUOUS_STATES * sizeof(real_T));
+			instance->stepSize = h * fmax(0.2, factor);
+			/* the outputs and derivatives of the current point have been overwritten */
+			instance->time = t;
+			instance->isDirtyValues = fmi2True;
+		}
+	}
+
+	instance->time = tEnd;
+
+	return fmi2OK;
+}
+#endif
+
+static void initializeVariableTable(const ModelVariable modelVariables[], BuiltInDTypeId dtypeID, size_t elementSize, VariableEntry table[]) {
+
+	size_t i;
+
+	for (i = N_MODEL_VARIABLES; i > 0; i--) {
+
+		const ModelVariable *v = &modelVariables[i - 1];
+		VariableEntry *entry = &table[i - 1];
+
+		if (v->dtypeID != dtypeID) {
+			entry->address = NULL;
+			entry->length  = 0;
+			continue;
+		}
+
+		entry->address = v->address;
+		entry->length  = 1;
+
+		/* extend the run of the next variable if it is stored right after this one */
+		if (i < N_MODEL_VARIABLES && table[i].address == (char *)v->address + elementSize) {
+			entry->length += table[i].length;
+		}
+	}
+}
+
+static void initializeVariableTables(ModelInstance *instance) {
+	initializeVariableTable(instance->modelVariables, SS_DOUBLE, sizeof(REAL64_T), instance->realVariables);
+	initializeVariableTable(instance->modelVariables, SS_INT32, sizeof(INT32_T), instance->integerVariables);
+}
+
+#ifdef N_CONTINUOUS_STATES
+/* bind der(ContinuousStates[i]) to the derivatives of the instance (rtmGetdX() points to the work arrays of the solver) */
+static void initializeDerivativeVariables(ModelInstance *instance) {
+	for (size_t i = 0; i < N_CONTINUOUS_STATES; i++) {
+		instance->modelVariables[FIRST_DERIVATIVE_VR - 1 + i].address = &instance->derivatives[i];
+	}
+}
+#endif
+
+/* number of requested value references from vr[0] that can be copied with one memcpy() */
+static size_t runLength(const VariableEntry *entry, const fmi2ValueReference vr[], size_t nvr) {
+
+	size_t n = 1;
+
+	while (n < entry->length && n < nvr && vr[n] == vr[0] + n) {
+		n++;
+	}
+
+	return n;
+}
+
+static size_t stateSize(const ModelInstance *instance) {
+
+	size_t size = ALIGN_STATE(sizeof(ModelState));
+
+	for (size_t i = 0; i < N_STATE_REGIONS; i++) {
+		size += ALIGN_STATE(instance->stateRegions[i].size);
+	}
+
+	return size;
+}
+
+static void getState(const ModelInstance *instance, ModelState *state) {
+
+	char *data = (char *)state + ALIGN_STATE(sizeof(ModelState));
+
+	state->size = stateSize(instance);
+#ifdef N_CONTINUOUS_STATES
+	state->time = instance->time;
+	state->nextEventTime = instance->nextEventTime;
+#endif
+
+	for (size_t i = 0; i < N_STATE_REGIONS; i++) {
+		const StateRegion *region = &instance->stateRegions[i];
+		memcpy(data, region->address, region->size);
+		data += ALIGN_STATE(region->size);
+	}
+}
+
+static void setState(ModelInstance *instance, const ModelState *state) {
+
+	const char *data = (const char *)state + ALIGN_STATE(sizeof(ModelState));
+
+#ifdef rtmSetTPtr
+	time_T *tPtr = rtmGetTPtr(instance->S);
+#endif
+
+#ifdef N_CONTINUOUS_STATES
+	instance->time = state->time;
+	instance->nextEventTime = state->nextEventTime;
+#endif
+
+	for (size_t i = 0; i < N_STATE_REGIONS; i++) {
+		const StateRegion *region = &instance->stateRegions[i];
+		memcpy(region->address, data, region->size);
+		data += ALIGN_STATE(region->size);
+	}
+
+#ifdef rtmSetTPtr
+	/* the time pointer in the timing data pointed to the time array of the instance that saved the state */
+	rtmSetTPtr(instance->S, tPtr);
 #endif
 }
 
@@ -125,6 +510,19 @@ fmi2Status  fmi2SetDebugLogging(fmi2Component c,
     return fmi2Error;
 }
 
+/* decrement the number of instances and free the path to the resources directory with the last one */
+static void releaseInstance(void) {
+
+    LOCK_INSTANCES;
+
+    if (--s_nInstances == 0) {
+        free((void *)FMU_RESOURCES_DIR);
+        FMU_RESOURCES_DIR = NULL;
+    }
+
+    UNLOCK_INSTANCES;
+}
+
 /* Creation and destruction of FMU instances and setting debug status */
 fmi2Component fmi2Instantiate(fmi2String instanceName,
 	fmi2Type fmuType,
@@ -140,20 +538,33 @@ fmi2Component fmi2Instantiate(fmi2String instanceName,
 	size_t len;
 
     /* check interface type */
+#ifdef N_CONTINUOUS_STATES
+    if (fmuType != fmi2CoSimulation && fmuType != fmi2ModelExchange) {
+        return NULL;
+    }
+#else
     if (fmuType != fmi2CoSimulation) {
         return NULL;
     }
+#endif
 
 	/* check GUID */
 	if (strcmp(fmuGUID, MODEL_GUID) != 0) {
 		return NULL;
 	}
 
+    LOCK_INSTANCES;
+
+#if !MULTI_INSTANCE
     /* check if the FMU has already been instantiated */
-    if (s_instance) {
-        logError("The FMU can only be instantiated once per process.");
+    if (s_nInstances > 0) {
+        UNLOCK_INSTANCES;
+        if (functions->logger) {
+            functions->logger(functions->componentEnvironment, instanceName, fmi2Error, "error", "The FMU can only be instantiated once per process.");
+        }
         return NULL;
     }
+#endif
 
 	/* set the path to the resources directory */
     if (fmuResourceLocation && !FMU_RESOURCES_DIR) {
@@ -178,36 +589,75 @@ fmi2Component fmi2Instantiate(fmi2String instanceName,
         }
     }
 
-    s_instance = (ModelInstance*)calloc(1, sizeof(ModelInstance));
+    /* count the instance before the model is instantiated so that a second
+       instance of a non-reusable model cannot be created concurrently */
+    s_nInstances++;
+
+    UNLOCK_INSTANCES;
 
-	if (!s_instance) {
+    ModelInstance *instance = (ModelInstance*)calloc(1, sizeof(ModelInstance));
+
+	if (!instance) {
+		releaseInstance();
 		return NULL;
 	}
 
 #ifdef RT_MDL_P
-	memcpy(&s_instance->defaultParameters, &RT_MDL_P, sizeof(RT_MDL_P_T));
+	memcpy(&instance->defaultParameters, &RT_MDL_P, sizeof(RT_MDL_P_T));
+#endif
+	instance->instanceName = strdup(instanceName);
+    instance->type = fmuType;
+#ifdef VARIABLE_STEP_SOLVER
+    instance->relativeTolerance = 1e-6;
 #endif
-	s_instance->instanceName = strdup(instanceName);
-    s_instance->logger = functions->logger;
-    s_instance->componentEnvironment = functions->componentEnvironment;
+    instance->logger = functions->logger;
+    instance->componentEnvironment = functions->componentEnvironment;
 
-    s_instance->S = RT_MDL_INSTANCE;
+    s_activeInstance = instance;
 
-	initializeModelVariables(s_instance->S, s_instance->modelVariables);
+    instance->S = RT_MDL_INSTANCE;
 
-	return s_instance;
+    if (!instance->S) {
+        logError(instance, RT_MEMORY_ALLOCATION_ERROR);
+        s_activeInstance = NULL;
+        free((void *)instance->instanceName);
+        free(instance);
+        releaseInstance();
+        return NULL;
+    }
+
+	initializeModelVariables(instance->S, instance->modelVariables);
+#ifdef N_CONTINUOUS_STATES
+	initializeDerivativeVariables(instance);
+#endif
+	initializeVariableTables(instance);
+	initializeStateRegions(instance->S, instance->stateRegions);
+
+	return instance;
 }
 
 void fmi2FreeInstance(fmi2Component c) {
 
-    if (!c || c != s_instance) return;
-		
-	free((void *)s_instance->instanceName);
-	free(s_instance);
-    free((void *)FMU_RESOURCES_DIR);
+    if (!c) return;
+
+    ModelInstance *instance = (ModelInstance *)c;
+
+#if MULTI_INSTANCE
+    /* free the model data */
+    if (instance->S) {
+        s_activeInstance = instance;
+        MODEL_TERMINATE(instance->S);
+    }
+#endif
+
+    if (s_activeInstance == instance) {
+        s_activeInstance = NULL;
+    }
+
+	free((void *)instance->instanceName);
+	free(instance);
 
-	FMU_RESOURCES_DIR = NULL;
-    s_instance = NULL;
+    releaseInstance();
 }
 
 /* Enter and exit initialization mode, terminate and reset */
@@ -218,18 +668,22 @@ fmi2Status fmi2SetupExperiment(fmi2Component c,
 	fmi2Boolean stopTimeDefined,
 	fmi2Real stopTime) {
 
+	ASSERT_INSTANCE
+
+#ifdef VARIABLE_STEP_SOLVER
+	instance->relativeTolerance = toleranceDefined ? tolerance : 1e-6;
+#else
     UNUSED(toleranceDefined);
     UNUSED(tolerance);
-
-	ASSERT_INSTANCE
+#endif
 
     if (startTime != 0) {
-        logError("startTime != 0.0 is not supported.");
+        logError(instance, "startTime != 0.0 is not supported.");
         return fmi2Error;
     }
 
 	if (stopTimeDefined && stopTime <= startTime) {
-        logError("stopTime must be greater than startTime.");
+        logError(instance, "stopTime must be greater than startTime.");
 		return fmi2Error;
 	}
 
@@ -240,10 +694,21 @@ fmi2Status fmi2EnterInitializationMode(fmi2Component c) {
 
 	ASSERT_INSTANCE
 
-	MODEL_INITIALIZE();
+	MODEL_INITIALIZE(instance->S);
 
 	CHECK_ERROR_STATUS
 
+#ifdef N_CONTINUOUS_STATES
+	instance->time = 0;
+	instance->nextEventTime = 0;
+	instance->isInitialized = fmi2True;
+	instance->isDirtyValues = instance->type == fmi2ModelExchange;
+#endif
+
+#ifdef VARIABLE_STEP_SOLVER
+	instance->stepSize = STEP_SIZE;
+#endif
+
 	return fmi2OK;
 }
 
@@ -251,7 +716,16 @@ fmi2Status fmi2ExitInitializationMode(fmi2Component c) {
 
 	ASSERT_INSTANCE
 
-	doFixedStep(s_instance->S);
+	/* Model Exchange does the first step at the initial event */
+	if (instance->type == fmi2ModelExchange) {
+		return fmi2OK;
+	}
+
+#ifdef VARIABLE_STEP_SOLVER
+	doEventStep(instance);
+#else
+	doFixedStep(instance->S);
+#endif
 
 	CHECK_ERROR_STATUS
 
@@ -262,9 +736,9 @@ fmi2Status fmi2Terminate(fmi2Component c) {
 
 	ASSERT_INSTANCE
 
-	MODEL_TERMINATE();
+	MODEL_TERMINATE(instance->S);
 
-	s_instance->S = NULL;
+	instance->S = NULL;
 
 	return fmi2OK;
 }
@@ -273,14 +747,32 @@ fmi2Status fmi2Reset(fmi2Component c) {
 
 	ASSERT_INSTANCE
 
-    if (s_instance->S) {
-        MODEL_TERMINATE();
+    if (instance->S) {
+        MODEL_TERMINATE(instance->S);
     }
 
-	s_instance->S = RT_MDL_INSTANCE;
+	instance->S = RT_MDL_INSTANCE;
+
+    if (!instance->S) {
+        logError(instance, RT_MEMORY_ALLOCATION_ERROR);
+        return fmi2Error;
+    }
 
 #ifdef RT_MDL_P
-	memcpy(&RT_MDL_P, &s_instance->defaultParameters, sizeof(RT_MDL_P_T));
+	memcpy(&RT_MDL_P, &instance->defaultParameters, sizeof(RT_MDL_P_T));
+#endif
+
+    /* the model data of reusable models is re-allocated */
+	initializeModelVariables(instance->S, instance->modelVariables);
+#ifdef N_CONTINUOUS_STATES
+	initializeDerivativeVariables(instance);
+#endif
+	initializeVariableTables(instance);
+	initializeStateRegions(instance->S, instance->stateRegions);
+
+#ifdef N_CONTINUOUS_STATES
+	instance->isInitialized = fmi2False;
+	instance->isDirtyValues = fmi2False;
 #endif
 
 	return fmi2OK;
@@ -290,11 +782,18 @@ fmi2Status fmi2Reset(fmi2Component c) {
 fmi2Status fmi2GetReal(fmi2Component c, const fmi2ValueReference vr[], size_t nvr, fmi2Real value[]) {
 
 	ASSERT_INSTANCE
+
+#ifdef N_CONTINUOUS_STATES
+	if (instance->isDirtyValues) {
+		evaluateModel(instance);
+	}
+#endif
 		
-	size_t i, index;
-	ModelVariable v;
+	size_t i, index, n;
+	const VariableEntry *entry;
+	const ModelVariable *v;
 
-	for (i = 0; i < nvr; i++) {
+	for (i = 0; i < nvr; i += n) {
 		
 		index = vr[i] - 1;
 
@@ -302,14 +801,20 @@ fmi2Status fmi2GetReal(fmi2Component c, const fmi2ValueReference vr[], size_t nv
 			return fmi2Error;
 		}
 
-		v = s_instance->modelVariables[index];
+		entry = &instance->realVariables[index];
 
-		switch (v.dtypeID) {
-		case SS_DOUBLE:
-			value[i] = *(REAL64_T *)v.address;
-			break;
+		if (entry->address) {
+			n = runLength(entry, &vr[i], nvr - i);
+			memcpy(&value[i], entry->address, n * sizeof(fmi2Real));
+			continue;
+		}
+
+		n = 1;
+		v = &instance->modelVariables[index];
+
+		switch (v->dtypeID) {
 		case SS_SINGLE:
-			value[i] = *(REAL32_T *)v.address;
+			value[i] = *(REAL32_T *)v->address;
 			break;
 		default:
 			return fmi2Error;
@@ -322,11 +827,18 @@ fmi2Status fmi2GetReal(fmi2Component c, const fmi2ValueReference vr[], size_t nv
 fmi2Status fmi2GetInteger(fmi2Component c, const fmi2ValueReference vr[], size_t nvr, fmi2Integer value[]) {
 
 	ASSERT_INSTANCE
+
+#ifdef N_CONTINUOUS_STATES
+	if (instance->isDirtyValues) {
+		evaluateModel(instance);
+	}
+#endif
 		
-	size_t i, index;
-	ModelVariable v;
+	size_t i, index, n;
+	const VariableEntry *entry;
+	const ModelVariable *v;
 
-	for (i = 0; i < nvr; i++) {
+	for (i = 0; i < nvr; i += n) {
 
 		index = vr[i] - 1;
 
@@ -334,26 +846,32 @@ fmi2Status fmi2GetInteger(fmi2Component c, const fmi2ValueReference vr[], size_t
 			return fmi2Error;
 		}
 
-		v = s_instance->modelVariables[index];
+		entry = &instance->integerVariables[index];
+
+		if (entry->address) {
+			n = runLength(entry, &vr[i], nvr - i);
+			memcpy(&value[i], entry->address, n * sizeof(fmi2Integer));
+			continue;
+		}
+
+		n = 1;
+		v = &instance->modelVariables[index];
 
-		switch (v.dtypeID) {
+		switch (v->dtypeID) {
 		case SS_INT8:
-			value[i] = *(INT8_T *)v.address;
+			value[i] = *(INT8_T *)v->address;
 			break;
 		case SS_UINT8:
-			value[i] = *(UINT8_T *)v.address;
+			value[i] = *(UINT8_T *)v->address;
 			break;
 		case SS_INT16:
-			value[i] = *(INT16_T *)v.address;
+			value[i] = *(INT16_T *)v->address;
 			break;
 		case SS_UINT16:
-			value[i] = *(UINT16_T *)v.address;
-			break;
-		case SS_INT32:
-			value[i] = *(INT32_T *)v.address;
+			value[i] = *(UINT16_T *)v->address;
 			break;
 		case SS_UINT32:
-			value[i] = *(UINT32_T *)v.address;
+			value[i] = *(UINT32_T *)v->address;
 			break;
 		default:
 			return fmi2Error;
@@ -367,8 +885,14 @@ fmi2Status fmi2GetBoolean(fmi2Component c, const fmi2ValueReference vr[], size_t
 
 	ASSERT_INSTANCE
 
+#ifdef N_CONTINUOUS_STATES
+	if (instance->isDirtyValues) {
+		evaluateModel(instance);
+	}
+#endif
+
 	size_t i, index;
-	ModelVariable v;
+	const ModelVariable *v;
 
 	for (i = 0; i < nvr; i++) {
 
@@ -378,15 +902,13 @@ fmi2Status fmi2GetBoolean(fmi2Component c, const fmi2ValueReference vr[], size_t
 			return fmi2Error;
 		}
 
-		v = s_instance->modelVariables[index];
+		v = &instance->modelVariables[index];
 
-		switch (v.dtypeID) {
-		case SS_BOOLEAN:
-			value[i] = *(BOOLEAN_T *)v.address;
-			break;
-		default:
+		if (v->dtypeID != SS_BOOLEAN) {
 			return fmi2Error;
 		}
+
+		value[i] = *(BOOLEAN_T *)v->address;
 	}
 
 	return fmi2OK;
@@ -405,11 +927,16 @@ fmi2Status fmi2GetString(fmi2Component c, const fmi2ValueReference vr[], size_t
 fmi2Status fmi2SetReal(fmi2Component c, const fmi2ValueReference vr[], size_t nvr, const fmi2Real value[]) { 
 
 	ASSERT_INSTANCE
+
+#ifdef N_CONTINUOUS_STATES
+	instance->isDirtyValues = instance->type == fmi2ModelExchange;
+#endif
 		
-	size_t i, index;
-	ModelVariable v;
+	size_t i, index, n;
+	const VariableEntry *entry;
+	const ModelVariable *v;
 
-	for (i = 0; i < nvr; i++) {
+	for (i = 0; i < nvr; i += n) {
 
 		index = vr[i] - 1;
 
@@ -417,18 +944,24 @@ fmi2Status fmi2SetReal(fmi2Component c, const fmi2ValueReference vr[], size_t nv
 			return fmi2Error;
 		}
 
-		v = s_instance->modelVariables[index];
+		entry = &instance->realVariables[index];
 
-		switch (v.dtypeID) {
-		case SS_DOUBLE:
-			*((REAL64_T *)v.address) = value[i];
-			break;
+		if (entry->address) {
+			n = runLength(entry, &vr[i], nvr - i);
+			memcpy(entry->address, &value[i], n * sizeof(fmi2Real));
+			continue;
+		}
+
+		n = 1;
+		v = &instance->modelVariables[index];
+
+		switch (v->dtypeID) {
 		case SS_SINGLE:
 			if (value[i] < -FLT_MAX || value[i] > FLT_MAX) {
 				// TODO: log this
 				return fmi2Error;
 			}
-			*((REAL32_T *)v.address) = (REAL32_T)value[i];
+			*((REAL32_T *)v->address) = (REAL32_T)value[i];
 			break;
 		default:
 			return fmi2Error;
@@ -441,11 +974,16 @@ fmi2Status fmi2SetReal(fmi2Component c, const fmi2ValueReference vr[], size_t nv
 fmi2Status fmi2SetInteger(fmi2Component c, const fmi2ValueReference vr[], size_t nvr, const fmi2Integer value[]) {
 
 	ASSERT_INSTANCE
+
+#ifdef N_CONTINUOUS_STATES
+	instance->isDirtyValues = instance->type == fmi2ModelExchange;
+#endif
 		
-	size_t i, index;
-	ModelVariable v;
+	size_t i, index, n;
+	const VariableEntry *entry;
+	const ModelVariable *v;
 
-	for (i = 0; i < nvr; i++) {
+	for (i = 0; i < nvr; i += n) {
 
 		index = vr[i] - 1;
 
@@ -453,26 +991,32 @@ fmi2Status fmi2SetInteger(fmi2Component c, const fmi2ValueReference vr[], size_t
 			return fmi2Error;
 		}
 
-		v = s_instance->modelVariables[index];
+		entry = &instance->integerVariables[index];
+
+		if (entry->address) {
+			n = runLength(entry, &vr[i], nvr - i);
+			memcpy(entry->address, &value[i], n * sizeof(fmi2Integer));
+			continue;
+		}
+
+		n = 1;
+		v = &instance->modelVariables[index];
 
-		switch (v.dtypeID) {
+		switch (v->dtypeID) {
 		case SS_INT8:
-			*((INT8_T *)v.address) = (INT8_T)value[i];
+			*((INT8_T *)v->address) = (INT8_T)value[i];
 			break;
 		case SS_UINT8:
-			*((UINT8_T *)v.address) = (UINT8_T)value[i];
+			*((UINT8_T *)v->address) = (UINT8_T)value[i];
 			break;
 		case SS_INT16:
-			*((INT16_T *)v.address) = (INT16_T)value[i];
+			*((INT16_T *)v->address) = (INT16_T)value[i];
 			break;
 		case SS_UINT16:
-			*((UINT16_T *)v.address) = (UINT16_T)value[i];
-			break;
-		case SS_INT32:
-			*((INT32_T *)v.address) = value[i];
+			*((UINT16_T *)v->address) = (UINT16_T)value[i];
 			break;
 		case SS_UINT32:
-			*((UINT32_T *)v.address) = value[i];
+			*((UINT32_T *)v->address) = value[i];
 			break;
 		default:
 			return fmi2Error;
@@ -485,9 +1029,13 @@ fmi2Status fmi2SetInteger(fmi2Component c, const fmi2ValueReference vr[], size_t
 fmi2Status fmi2SetBoolean(fmi2Component c, const fmi2ValueReference vr[], size_t nvr, const fmi2Boolean value[]) {
 
 	ASSERT_INSTANCE
+
+#ifdef N_CONTINUOUS_STATES
+	instance->isDirtyValues = instance->type == fmi2ModelExchange;
+#endif
 		
 	size_t i, index;
-	ModelVariable v;
+	const ModelVariable *v;
 
 	for (i = 0; i < nvr; i++) {
 
@@ -497,15 +1045,13 @@ fmi2Status fmi2SetBoolean(fmi2Component c, const fmi2ValueReference vr[], size_t
 			return fmi2Error;
 		}
 
-		v = s_instance->modelVariables[index];
+		v = &instance->modelVariables[index];
 
-		switch (v.dtypeID) {
-		case SS_BOOLEAN:
-			*((BOOLEAN_T *)v.address) = (BOOLEAN_T)value[i];
-			break;
-		default:
+		if (v->dtypeID != SS_BOOLEAN) {
 			return fmi2Error;
 		}
+
+		*((BOOLEAN_T *)v->address) = (BOOLEAN_T)value[i];
 	}
 
 	return fmi2OK;
@@ -524,55 +1070,115 @@ fmi2Status fmi2SetString(fmi2Component c, const fmi2ValueReference vr[], size_t
 /* Getting and setting the internal FMU state */
 fmi2Status fmi2GetFMUstate(fmi2Component c, fmi2FMUstate* FMUstate) {
 
-    UNUSED(c);
-    UNUSED(FMUstate);
+	ASSERT_INSTANCE
 
-    NOT_IMPLEMENTED
+	if (!instance->S) {
+		logError(instance, "The FMU has been terminated.");
+		return fmi2Error;
+	}
+
+	/* re-use a previously allocated state */
+	if (!*FMUstate) {
+
+		*FMUstate = malloc(stateSize(instance));
+
+		if (!*FMUstate) {
+			logError(instance, RT_MEMORY_ALLOCATION_ERROR);
+			return fmi2Error;
+		}
+	}
+
+	getState(instance, (ModelState *)*FMUstate);
+
+	return fmi2OK;
 }
 
 fmi2Status fmi2SetFMUstate(fmi2Component c, fmi2FMUstate  FMUstate) {
 
-    UNUSED(c);
-    UNUSED(FMUstate);
+	ASSERT_INSTANCE
 
-    NOT_IMPLEMENTED
+	if (!instance->S || !FMUstate || ((ModelState *)FMUstate)->size != stateSize(instance)) {
+		logError(instance, "Invalid FMU state.");
+		return fmi2Error;
+	}
+
+	setState(instance, (const ModelState *)FMUstate);
+
+#ifdef N_CONTINUOUS_STATES
+	instance->isDirtyValues = instance->type == fmi2ModelExchange;
+#endif
+
+	return fmi2OK;
 }
 
 fmi2Status fmi2FreeFMUstate(fmi2Component c, fmi2FMUstate* FMUstate) {
 
-	UNUSED(c);
-	UNUSED(FMUstate);
+	ASSERT_INSTANCE
 
-	NOT_IMPLEMENTED
+	if (FMUstate) {
+		free(*FMUstate);
+		*FMUstate = NULL;
+	}
+
+	return fmi2OK;
 }
 
 fmi2Status fmi2SerializedFMUstateSize(fmi2Component c, fmi2FMUstate  FMUstate, size_t* size) {
 
-    UNUSED(c);
-    UNUSED(FMUstate);
-    UNUSED(size);
+	ASSERT_INSTANCE
 
-    NOT_IMPLEMENTED
+	if (!FMUstate) {
+		logError(instance, "Invalid FMU state.");
+		return fmi2Error;
+	}
+
+	*size = ((ModelState *)FMUstate)->size;
+
+	return fmi2OK;
 }
 
 fmi2Status fmi2SerializeFMUstate(fmi2Component c, fmi2FMUstate  FMUstate, fmi2Byte serializedState[], size_t size) {
 
-    UNUSED(c);
-    UNUSED(FMUstate);
-    UNUSED(serializedState);
-    UNUSED(size);
+	ASSERT_INSTANCE
 
-    NOT_IMPLEMENTED
+	if (!FMUstate || size < ((ModelState *)FMUstate)->size) {
+		logError(instance, "The buffer for the serialized FMU state is too small.");
+		return fmi2Error;
+	}
+
+	memcpy(serializedState, FMUstate, ((ModelState *)FMUstate)->size);
+
+	return fmi2OK;
 }
 
 fmi2Status fmi2DeSerializeFMUstate(fmi2Component c, const fmi2Byte serializedState[], size_t size, fmi2FMUstate* FMUstate) {
 
-    UNUSED(c);
-    UNUSED(serializedState);
-    UNUSED(size);
-    UNUSED(FMUstate);
+	ASSERT_INSTANCE
 
-    NOT_IMPLEMENTED
+	size_t serializedSize = 0;
+
+	if (size >= sizeof(size_t)) {
+		memcpy(&serializedSize, serializedState, sizeof(size_t));
+	}
+
+	if (size != stateSize(instance) || serializedSize != size) {
+		logError(instance, "The serialized FMU state does not match the FMU.");
+		return fmi2Error;
+	}
+
+	if (!*FMUstate) {
+
+		*FMUstate = malloc(size);
+
+		if (!*FMUstate) {
+			logError(instance, RT_MEMORY_ALLOCATION_ERROR);
+			return fmi2Error;
+		}
+	}
+
+	memcpy(*FMUstate, serializedState, size);
+
+	return fmi2OK;
 }
 
 /* Getting partial derivatives */
@@ -600,25 +1206,59 @@ Types for Functions for FMI2 for Model Exchange
 /* Enter and exit the different modes */
 fmi2Status fmi2EnterEventMode(fmi2Component c) { 
 
+#ifdef N_CONTINUOUS_STATES
+	ASSERT_INSTANCE
+
+	return fmi2OK;
+#else
     UNUSED(c);
 
     NOT_IMPLEMENTED
+#endif
 }
 
 fmi2Status fmi2NewDiscreteStates(fmi2Component c, fmi2EventInfo* fmi2eventInfo) {
 
+#ifdef N_CONTINUOUS_STATES
+	ASSERT_INSTANCE
+
+	double epsilon = (1.0 + fabs(instance->time)) * 2 * DBL_EPSILON;
+
+	if (instance->time + epsilon >= instance->nextEventTime) {
+
+		doEventStep(instance);
+
+		CHECK_ERROR_STATUS
+	}
+
+	fmi2eventInfo->newDiscreteStatesNeeded           = fmi2False;
+	fmi2eventInfo->terminateSimulation               = fmi2False;
+	fmi2eventInfo->nominalsOfContinuousStatesChanged = fmi2False;
+	fmi2eventInfo->valuesOfContinuousStatesChanged   = fmi2False;
+	fmi2eventInfo->nextEventTimeDefined              = instance->nextEventTime < INFINITY;
+	fmi2eventInfo->nextEventTime                     = instance->nextEventTime;
+
+	return fmi2OK;
+#else
     UNUSED(c);
     UNUSED(fmi2eventInfo);
 
     NOT_IMPLEMENTED
+#endif
 }
 
 
 fmi2Status fmi2EnterContinuousTimeMode(fmi2Component c) {
 
+#ifdef N_CONTINUOUS_STATES
+	ASSERT_INSTANCE
+
+	return fmi2OK;
+#else
     UNUSED(c);
 
     NOT_IMPLEMENTED
+#endif
 }
 
 fmi2Status fmi2CompletedIntegratorStep(fmi2Component c,
@@ -626,67 +1266,162 @@ fmi2Status fmi2CompletedIntegratorStep(fmi2Component c,
 	fmi2Boolean*  enterEventMode,
 	fmi2Boolean*  terminateSimulation) {
 
-    UNUSED(c);
     UNUSED(noSetFMUStatePriorToCurrentPoint);
+
+#ifdef N_CONTINUOUS_STATES
+	ASSERT_INSTANCE
+
+	*enterEventMode = fmi2False;
+	*terminateSimulation = fmi2False;
+
+	return fmi2OK;
+#else
+    UNUSED(c);
     UNUSED(enterEventMode);
     UNUSED(terminateSimulation);
 
     NOT_IMPLEMENTED
+#endif
 }
 
 /* Providing independent variables and re-initialization of caching */
 fmi2Status fmi2SetTime(fmi2Component c, fmi2Real time) {
 
+#ifdef N_CONTINUOUS_STATES
+	ASSERT_INSTANCE
+
+	instance->time = time;
+	instance->isDirtyValues = fmi2True;
+
+	return fmi2OK;
+#else
     UNUSED(c);
     UNUSED(time);
 
     NOT_IMPLEMENTED
+#endif
 }
 
 fmi2Status fmi2SetContinuousStates(fmi2Component c, const fmi2Real x[], size_t nx) {
 
+#ifdef N_CONTINUOUS_STATES
+	ASSERT_INSTANCE
+
+	if (nx != N_CONTINUOUS_STATES) {
+		logError(instance, "Argument nx must be equal to the number of continuous states.");
+		return fmi2Error;
+	}
+
+	memcpy(rtmGetContStates(instance->S), x, nx * sizeof(fmi2Real));
+
+	instance->isDirtyValues = fmi2True;
+
+	return fmi2OK;
+#else
     UNUSED(c);
     UNUSED(x);
     UNUSED(nx);
 
     NOT_IMPLEMENTED
+#endif
 }
 
 /* Evaluation of the model equations */
 fmi2Status fmi2GetDerivatives(fmi2Component c, fmi2Real derivatives[], size_t nx) {
 
+#ifdef N_CONTINUOUS_STATES
+	ASSERT_INSTANCE
+
+	if (nx != N_CONTINUOUS_STATES) {
+		logError(instance, "Argument nx must be equal to the number of continuous states.");
+		return fmi2Error;
+	}
+
+	if (instance->isDirtyValues) {
+		evaluateModel(instance);
+		CHECK_ERROR_STATUS
+	}
+
+	memcpy(derivatives, instance->derivatives, nx * sizeof(fmi2Real));
+
+	return fmi2OK;
+#else
     UNUSED(c);
     UNUSED(derivatives);
     UNUSED(nx);
 
     NOT_IMPLEMENTED
+#endif
 }
 
 fmi2Status fmi2GetEventIndicators(fmi2Component c, fmi2Real eventIndicators[], size_t ni) {
 
-    UNUSED(c);
     UNUSED(eventIndicators);
+
+#ifdef N_CONTINUOUS_STATES
+	ASSERT_INSTANCE
+
+	/* the fixed-step code has no zero-crossing functions */
+	if (ni != 0) {
+		logError(instance, "Argument ni must be 0.");
+		return fmi2Error;
+	}
+
+	return fmi2OK;
+#else
+    UNUSED(c);
     UNUSED(ni);
 
     NOT_IMPLEMENTED
+#endif
 }
 
 fmi2Status fmi2GetContinuousStates(fmi2Component c, fmi2Real x[], size_t nx) {
 
+#ifdef N_CONTINUOUS_STATES
+	ASSERT_INSTANCE
+
+	if (nx != N_CONTINUOUS_STATES) {
+		logError(instance, "Argument nx must be equal to the number of continuous states.");
+		return fmi2Error;
+	}
+
+	memcpy(x, rtmGetContStates(instance->S), nx * sizeof(fmi2Real));
+
+	return fmi2OK;
+#else
     UNUSED(c);
     UNUSED(x);
     UNUSED(nx);
 
     NOT_IMPLEMENTED
+#endif
 }
 
 fmi2Status fmi2GetNominalsOfContinuousStates(fmi2Component c, fmi2Real x_nominal[], size_t nx) {
 
+#ifdef N_CONTINUOUS_STATES
+	ASSERT_INSTANCE
+
+	size_t i;
+
+	if (nx != N_CONTINUOUS_STATES) {
+		logError(instance, "Argument nx must be equal to the number of continuous states.");
+		return fmi2Error;
+	}
+
+	for (i = 0; i < nx; i++) {
+		x_nominal[i] = 1;
+	}
+
+	return fmi2OK;
+#else
     UNUSED(c);
     UNUSED(x_nominal);
     UNUSED(nx);
 
     NOT_IMPLEMENTED
+#endif
 }
 
 
@@ -731,19 +1466,53 @@ fmi2Status fmi2DoStep(fmi2Component c,
     UNUSED(noSetFMUStatePriorToCurrentPoint);
 
 	ASSERT_INSTANCE
-		
+
+#ifdef VARIABLE_STEP_SOLVER
+	fmi2Real tNext = currentCommunicationPoint + communicationStepSize;
+	double epsilon = (1.0 + fabs(tNext)) * 2 * DBL_EPSILON;
+
+	for (;;) {
+
+		/* update the discrete parts (also at the end of the communication step) */
+		if (instance->time + epsilon >= instance->nextEventTime) {
+			doEventStep(instance);
+			CHECK_ERROR_STATUS
+		}
+
+		if (instance->time + epsilon >= tNext) {
+			break;
+		}
+
+		if (integrate(instance, fmin(tNext, instance->nextEventTime)) > fmi2Warning) {
+			return fmi2Error;
+		}
+	}
+#else
+	RT_MDL_TYPE *S = instance->S;
+
 #ifdef rtmGetT
 	time_T tNext = currentCommunicationPoint + communicationStepSize;
-	double epsilon = (1.0 + fabs(rtmGetT(s_instance->S))) * 2 * DBL_EPSILON;
-	
-    while (rtmGetT(s_instance->S) < tNext + epsilon)
-#endif
-	{
-		doFixedStep(s_instance->S);
+	double epsilon = (1.0 + fabs(rtmGetT(S))) * 2 * DBL_EPSILON;
 
-		CHECK_ERROR_STATUS
+	/* take all but the last of the base steps with rtmGetT(S) < tNext + epsilon in a
+	   counted loop and leave the rounding at the communication point to the time check */
+	double steps = ceil((tNext + epsilon - rtmGetT(S)) / STEP_SIZE) - 1;
+	size_t i, nSteps = steps > 0 ? (size_t)steps : 0;
+
+	for (i = 0; i < nSteps && !rtmGetErrorStatus(S); i++) {
+		doFixedStep(S);
 	}
 
+	while (rtmGetT(S) < tNext + epsilon && !rtmGetErrorStatus(S)) {
+		doFixedStep(S);
+	}
+#else
+	doFixedStep(S);
+#endif
+
+	CHECK_ERROR_STATUS
+#endif
+
 	return fmi2OK;
 }
 
@@ -10,8 +10,23 @@
 #include <stdarg.h> /* for va_list */
 #include <stdio.h>  /* for vsnprintf(), vprintf() */
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h> /* for SRWLOCK */
+#else
+#include <pthread.h> /* for pthread_mutex_t */
+#endif
+
 #include "fmiwrapper.inc"
 
+/* pre-computed address, size and type of a model variable for getVariables() and setVariables() */
+typedef struct {
+    void *address;
+    size_t size;   /* number of elements */
+    size_t nBytes;
+    BuiltInDTypeId dtypeID;
+    int isContiguous; /* the variable with the next value reference has the same type and is stored right after this one */
+} VariableRecord;
 
 const char *RT_MEMORY_ALLOCATION_ERROR = "memory allocation error";
 
@@ -24,26 +39,70 @@ typedef struct {
     RT_MDL_P_T defaultParameters;
 #endif
     const char *instanceName;
+    fmi3Boolean scheduledExecution;
+    fmi3Boolean earlyReturnAllowed;
+    /* Scheduled Execution */
+    fmi3LockPreemptionCallback lockPreemption;
+    fmi3UnlockPreemptionCallback unlockPreemption;
+    long baseTick; /* base step of the last activation of the base rate (-1 before the first one) */
     fmi3LogMessageCallback logger;
     fmi3InstanceEnvironment componentEnvironment;
     ModelVariable modelVariables[N_MODEL_VARIABLES];
+    VariableRecord variableRecords[N_MODEL_VARIABLES];
+    StateRegion stateRegions[N_STATE_REGIONS];
+#if N_EVENT_OUTPUTS > 0
+    boolean_T eventValues[N_EVENT_VALUES];
+#endif
 } ModelInstance;
 
-static ModelInstance *s_instance = NULL;
+/* FMU state: the contents of the state regions (8 byte aligned) without the pointers of the RT model
+   so it can be restored by any instance of the FMU (also after a reset or in another process) */
+typedef struct {
+    size_t size;
+} ModelState;
+
+#define ALIGN_STATE(n) (((n) + 7) & ~(size_t)7)
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#define RESTRICT __restrict
+#else
+#define THREAD_LOCAL __thread
+#define RESTRICT restrict
+#endif
+
+/* number of instances (non-reusable models can only be instantiated once) */
+static int s_nInstances = 0;
+
+/* guards s_nInstances and FMU_RESOURCES_DIR against concurrent instantiation and fmi3FreeInstance() */
+#ifdef _WIN32
+static SRWLOCK s_instancesLock = SRWLOCK_INIT;
+#define LOCK_INSTANCES   AcquireSRWLockExclusive(&s_instancesLock)
+#define UNLOCK_INSTANCES ReleaseSRWLockExclusive(&s_instancesLock)
+#else
+static pthread_mutex_t s_instancesLock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_INSTANCES   pthread_mutex_lock(&s_instancesLock)
+#define UNLOCK_INSTANCES pthread_mutex_unlock(&s_instancesLock)
+#endif
+
+/* instance that executes the model code on the current thread (for rtPrintfNoOp()) */
+static THREAD_LOCAL ModelInstance *s_activeInstance = NULL;
 
 #define ASSERT_INSTANCE \
-    if (!instance || instance != s_instance) { \
+    if (!instance) { \
         return fmi3Error; \
-    }
+    } \
+    ModelInstance *modelInstance = (ModelInstance *)instance; \
+    s_activeInstance = modelInstance;
 
 #define NOT_IMPLEMENTED \
-    logError("Function is not implemented."); \
+    logError((ModelInstance *)instance, "Function is not implemented."); \
 	return fmi3Error;
 
 #define CHECK_ERROR_STATUS \
-	const char *errorStatus = rtmGetErrorStatus(s_instance->S); \
+	const char *errorStatus = rtmGetErrorStatus(modelInstance->S); \
 	if (errorStatus) { \
-		logError(errorStatus); \
+		logError(modelInstance, errorStatus); \
 		return fmi3Error; \
 	}
 
@@ -54,10 +113,10 @@ int rtPrintfNoOp(const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
 
-    if (s_instance && s_instance->logger) {
+    if (s_activeInstance && s_activeInstance->logger) {
         char message[1024] = "";
         vsnprintf(message, 1024, fmt, args);
-        s_instance->logger(s_instance->componentEnvironment, fmi3OK, "info", message);
+        s_activeInstance->logger(s_activeInstance->componentEnvironment, fmi3OK, "info", message);
     } else {
         vprintf(fmt, args);
     }
@@ -67,9 +126,9 @@ int rtPrintfNoOp(const char *fmt, ...) {
     return 0;
 }
 
-static void logError(const char *message) {
-    if (s_instance && s_instance->logger) {
-        s_instance->logger(s_instance->componentEnvironment, fmi3Error, "error", message);
+static void logError(ModelInstance *instance, const char *message) {
+    if (instance && instance->logger) {
+        instance->logger(instance->componentEnvironment, fmi3Error, "error", message);
     }
 }
 
@@ -78,12 +137,12 @@ static void doFixedStep(RT_MDL_TYPE *S) {
 #if NUM_TASKS > 1 // multitasking
 
     // step the model for the base sample time
-    MODEL_STEP(0);
+    MODEL_STEP(S, 0);
 
     // step the model for any other sample times (subrates)
     for (int i = FIRST_TASK_ID + 1; i < NUM_SAMPLE_TIMES; i++) {
         if (rtmStepTask(S, i)) {
-            MODEL_STEP(i);
+            MODEL_STEP(S, i);
         }
         if (++rtmTaskCounter(S, i) == rtmCounterLimit(S, i)) {
             rtmTaskCounter(S, i) = 0;
@@ -92,11 +151,128 @@ static void doFixedStep(RT_MDL_TYPE *S) {
 
 #else // singletasking
 
-    MODEL_STEP();
+    MODEL_STEP(S);
 
 #endif
 }
 
+#if N_EVENT_OUTPUTS > 0
+/* copy the values of the event outputs and return whether any of them has changed */
+static int updateEventValues(ModelInstance *modelInstance) {
+
+    int changed = 0;
+    boolean_T *value = modelInstance->eventValues;
+
+    for (size_t i = 0; i < N_EVENT_OUTPUTS; i++) {
+
+        const ModelVariable *variable = &modelInstance->modelVariables[eventOutputVRs[i] - 1];
+        const size_t nBytes = variable->size * sizeof(boolean_T);
+
+        if (memcmp(value, variable->address, nBytes)) {
+            memcpy(value, variable->address, nBytes);
+            changed = 1;
+        }
+
+        value += variable->size;
+    }
+
+    return changed;
+}
+#endif
+
+static size_t elementSize(BuiltInDTypeId dtypeID) {
+    switch (dtypeID) {
+    case SS_DOUBLE:  return sizeof(REAL64_T);
+    case SS_SINGLE:  return sizeof(REAL32_T);
+    case SS_INT8:    return sizeof(INT8_T);
+    case SS_UINT8:   return sizeof(UINT8_T);
+    case SS_INT16:   return sizeof(INT16_T);
+    case SS_UINT16:  return sizeof(UINT16_T);
+    case SS_INT32:   return sizeof(INT32_T);
+    case SS_UINT32:  return sizeof(UINT32_T);
+    case SS_BOOLEAN: return sizeof(BOOLEAN_T);
+    default:         return 0;
+    }
+}
+
+static void initializeVariableRecords(ModelInstance *instance) {
+
+    for (size_t i = 0; i < N_MODEL_VARIABLES; i++) {
+
+        const ModelVariable *v = &instance->modelVariables[i];
+        VariableRecord *record = &instance->variableRecords[i];
+
+        record->address      = v->address;
+        record->size         = v->size;
+        record->nBytes       = v->size * elementSize(v->dtypeID);
+        record->dtypeID      = v->dtypeID;
+        record->isContiguous = 0;
+
+        if (i > 0) {
+            VariableRecord *previous = &instance->variableRecords[i - 1];
+            previous->isContiguous = previous->dtypeID == record->dtypeID && previous->nBytes > 0 &&
+                (char *)previous->address + previous->nBytes == (char *)record->address;
+        }
+    }
+}
+
+/* element-wise loops without aliasing that the compiler can vectorize */
+static void getBooleans(fmi3Boolean *RESTRICT values, const BOOLEAN_T *RESTRICT data, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        values[i] = data[i] != 0;
+    }
+}
+
+static void setBooleans(BOOLEAN_T *RESTRICT data, const fmi3Boolean *RESTRICT values, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        data[i] = values[i] != fmi3False;
+    }
+}
+
+static size_t stateSize(const ModelInstance *instance) {
+
+    size_t size = ALIGN_STATE(sizeof(ModelState));
+
+    for (size_t i = 0; i < N_STATE_REGIONS; i++) {
+        size += ALIGN_STATE(instance->stateRegions[i].size);
+    }
+
+    return size;
+}
+
+static void getState(const ModelInstance *instance, ModelState *state) {
+
+    char *data = (char *)state + ALIGN_STATE(sizeof(ModelState));
+
+    state->size = stateSize(instance);
+
+    for (size_t i = 0; i < N_STATE_REGIONS; i++) {
+        const StateRegion *region = &instance->stateRegions[i];
+        memcpy(data, region->address, region->size);
+        data += ALIGN_STATE(region->size);
+    }
+}
+
+static void setState(ModelInstance *instance, const ModelState *state) {
+
+    const char *data = (const char *)state + ALIGN_STATE(sizeof(ModelState));
+
+#ifdef rtmSetTPtr
+    time_T *tPtr = rtmGetTPtr(instance->S);
+#endif
+
+    for (size_t i = 0; i < N_STATE_REGIONS; i++) {
+        const StateRegion *region = &instance->stateRegions[i];
+        memcpy(region->address, data, region->size);
+        data += ALIGN_STATE(region->size);
+    }
+
+#ifdef rtmSetTPtr
+    /* the time pointer in the timing data pointed to the time array of the instance that saved the state */
+    rtmSetTPtr(instance->S, tPtr);
+#endif
+}
+
 /***************************************************
 Types for Common Functions
 ****************************************************/
@@ -132,54 +308,110 @@ fmi3Instance fmi3InstantiateModelExchange(
 	return NULL; // not supported
 }
 
-fmi3Instance fmi3InstantiateCoSimulation(
+/* decrement the number of instances and free the path to the resources directory with the last one */
+static void releaseInstance(void) {
+
+    LOCK_INSTANCES;
+
+    if (--s_nInstances == 0) {
+        free((void *)FMU_RESOURCES_DIR);
+        FMU_RESOURCES_DIR = NULL;
+    }
+
+    UNLOCK_INSTANCES;
+}
+
+static ModelInstance *instantiate(
     fmi3String                     instanceName,
     fmi3String                     instantiationToken,
     fmi3String                     resourcePath,
-    fmi3Boolean                    visible,
-    fmi3Boolean                    loggingOn,
-    fmi3Boolean                    eventModeUsed,
-    fmi3Boolean                    earlyReturnAllowed,
-    const fmi3ValueReference       requiredIntermediateVariables[],
-    size_t                         nRequiredIntermediateVariables,
     fmi3InstanceEnvironment        instanceEnvironment,
-    fmi3LogMessageCallback         logMessage,
-    fmi3IntermediateUpdateCallback intermediateUpdate) {
+    fmi3LogMessageCallback         logMessage) {
 
 	/* check GUID */
 	if (strcmp(instantiationToken, MODEL_GUID) != 0) {
 		return NULL;
 	}
 
+    LOCK_INSTANCES;
+
+#if !MULTI_INSTANCE
     /* check if the FMU has already been instantiated */
-    if (s_instance) {
-        logError("The FMU can only be instantiated once per process.");
+    if (s_nInstances > 0) {
+        UNLOCK_INSTANCES;
+        if (logMessage) {
+            logMessage(instanceEnvironment, fmi3Error, "error", "The FMU can only be instantiated once per process.");
+        }
         return NULL;
     }
+#endif
 
     /* set the path to the resources directory */
     if (!FMU_RESOURCES_DIR && resourcePath) {
         FMU_RESOURCES_DIR = strdup(resourcePath);
     }
 
-    s_instance = (ModelInstance*)calloc(1, sizeof(ModelInstance));
+    /* count the instance before the model is instantiated so that a second
+       instance of a non-reusable model cannot be created concurrently */
+    s_nInstances++;
+
+    UNLOCK_INSTANCES;
 
-    if (!s_instance) {
+    ModelInstance *modelInstance = (ModelInstance*)calloc(1, sizeof(ModelInstance));
+
+    if (!modelInstance) {
+        releaseInstance();
         return NULL;
     }
 
 #ifdef RT_MDL_P
-    memcpy(&s_instance->defaultParameters, &RT_MDL_P, sizeof(RT_MDL_P_T));
+    memcpy(&modelInstance->defaultParameters, &RT_MDL_P, sizeof(RT_MDL_P_T));
 #endif
-    s_instance->instanceName = strdup(instanceName);
-    s_instance->logger = logMessage;
-    s_instance->componentEnvironment = instanceEnvironment;
+    modelInstance->instanceName = strdup(instanceName);
+    modelInstance->logger = logMessage;
+    modelInstance->componentEnvironment = instanceEnvironment;
+
+    s_activeInstance = modelInstance;
+
+    modelInstance->S = RT_MDL_INSTANCE;
+
+    if (!modelInstance->S) {
+        logError(modelInstance, RT_MEMORY_ALLOCATION_ERROR);
+        s_activeInstance = NULL;
+        free((void *)modelInstance->instanceName);
+        free(modelInstance);
+        releaseInstance();
+        return NULL;
+    }
 
-    s_instance->S = RT_MDL_INSTANCE;
+	initializeModelVariables(modelInstance->S, modelInstance->modelVariables);
+    initializeVariableRecords(modelInstance);
+    initializeStateRegions(modelInstance->S, modelInstance->stateRegions);
 
-	initializeModelVariables(s_instance->S, s_instance->modelVariables);
+	return modelInstance;
+}
+
+fmi3Instance fmi3InstantiateCoSimulation(
+    fmi3String                     instanceName,
+    fmi3String                     instantiationToken,
+    fmi3String                     resourcePath,
+    fmi3Boolean                    visible,
+    fmi3Boolean                    loggingOn,
+    fmi3Boolean                    eventModeUsed,
+    fmi3Boolean                    earlyReturnAllowed,
+    const fmi3ValueReference       requiredIntermediateVariables[],
+    size_t                         nRequiredIntermediateVariables,
+    fmi3InstanceEnvironment        instanceEnvironment,
+    fmi3LogMessageCallback         logMessage,
+    fmi3IntermediateUpdateCallback intermediateUpdate) {
+
+    ModelInstance *modelInstance = instantiate(instanceName, instantiationToken, resourcePath, instanceEnvironment, logMessage);
+
+    if (modelInstance) {
+        modelInstance->earlyReturnAllowed = earlyReturnAllowed;
+    }
 
-	return s_instance;
+    return modelInstance;
 }
 
 fmi3Instance fmi3InstantiateScheduledExecution(
@@ -194,19 +426,39 @@ fmi3Instance fmi3InstantiateScheduledExecution(
     fmi3LockPreemptionCallback     lockPreemption,
     fmi3UnlockPreemptionCallback   unlockPreemption) {
 
-	return NULL; // not supported
+    ModelInstance *modelInstance = instantiate(instanceName, instantiationToken, resourcePath, instanceEnvironment, logMessage);
+
+    if (modelInstance) {
+        modelInstance->scheduledExecution = fmi3True;
+        modelInstance->lockPreemption = lockPreemption;
+        modelInstance->unlockPreemption = unlockPreemption;
+    }
+
+    return modelInstance;
 }
 
 void fmi3FreeInstance(fmi3Instance instance) {
 
-    if (!instance || instance != s_instance) return;
+    if (!instance) return;
+
+    ModelInstance *modelInstance = (ModelInstance *)instance;
+
+#if MULTI_INSTANCE
+    /* free the model data */
+    if (modelInstance->S) {
+        s_activeInstance = modelInstance;
+        MODEL_TERMINATE(modelInstance->S);
+    }
+#endif
+
+    if (s_activeInstance == modelInstance) {
+        s_activeInstance = NULL;
+    }
 
-    free((void *)s_instance->instanceName);
-	free(s_instance);
-    free((void *)FMU_RESOURCES_DIR);
+    free((void *)modelInstance->instanceName);
+	free(modelInstance);
 
-    FMU_RESOURCES_DIR = NULL;
-    s_instance = NULL;
+    releaseInstance();
 }
 
 fmi3Status fmi3EnterInitializationMode(fmi3Instance instance,
@@ -219,19 +471,21 @@ fmi3Status fmi3EnterInitializationMode(fmi3Instance instance,
     ASSERT_INSTANCE
 
     if (startTime != 0) {
-        logError("startTime != 0.0 is not supported.");
+        logError(modelInstance, "startTime != 0.0 is not supported.");
         return fmi3Error;
     }
 
     if (stopTimeDefined && stopTime <= startTime) {
-        logError("stopTime must be greater than startTime.");
+        logError(modelInstance, "stopTime must be greater than startTime.");
         return fmi3Error;
     }
 
-    MODEL_INITIALIZE();
+    MODEL_INITIALIZE(modelInstance->S);
 
     CHECK_ERROR_STATUS
 
+    modelInstance->baseTick = -1;
+
 	return fmi3OK;
 }
 
@@ -239,7 +493,12 @@ fmi3Status fmi3ExitInitializationMode(fmi3Instance instance) {
     
     ASSERT_INSTANCE
 
-    doFixedStep(s_instance->S);
+    /* the scheduler activates the first steps of the model partitions */
+    if (modelInstance->scheduledExecution) {
+        return fmi3OK;
+    }
+
+    doFixedStep(modelInstance->S);
 
     CHECK_ERROR_STATUS
 
@@ -254,9 +513,9 @@ fmi3Status fmi3Terminate(fmi3Instance instance) {
 
     ASSERT_INSTANCE
 
-	MODEL_TERMINATE();
+	MODEL_TERMINATE(modelInstance->S);
 
-    s_instance->S = NULL;
+    modelInstance->S = NULL;
 
 	return fmi3OK;
 }
@@ -265,16 +524,26 @@ fmi3Status fmi3Reset(fmi3Instance instance) {
 
     ASSERT_INSTANCE
 
-    if (s_instance->S) {
-        MODEL_TERMINATE();
+    if (modelInstance->S) {
+        MODEL_TERMINATE(modelInstance->S);
     }
 
-    s_instance->S = RT_MDL_INSTANCE;
+    modelInstance->S = RT_MDL_INSTANCE;
+
+    if (!modelInstance->S) {
+        logError(modelInstance, RT_MEMORY_ALLOCATION_ERROR);
+        return fmi3Error;
+    }
 
 #ifdef RT_MDL_P
-    memcpy(&RT_MDL_P, &s_instance->defaultParameters, sizeof(RT_MDL_P_T));
+    memcpy(&RT_MDL_P, &modelInstance->defaultParameters, sizeof(RT_MDL_P_T));
 #endif
 
+    /* the model data of reusable models is re-allocated */
+    initializeModelVariables(modelInstance->S, modelInstance->modelVariables);
+    initializeVariableRecords(modelInstance);
+    initializeStateRegions(modelInstance->S, modelInstance->stateRegions);
+
 	return fmi3OK;
 }
 
@@ -285,8 +554,9 @@ static fmi3Status getVariables(ModelInstance *instance,
 	const fmi3ValueReference vr[], size_t nvr,
 	void *values, size_t nValues, BuiltInDTypeId datatypeID, size_t typeSize) {
 
-	size_t i, j, index, copied = 0;
-	ModelVariable v;
+	size_t i, index, size, nBytes, copied = 0;
+	const VariableRecord *record;
+	const void *address;
 
 	for (i = 0; i < nvr; i++) {
 
@@ -311,27 +581,37 @@ static fmi3Status getVariables(ModelInstance *instance,
 			return fmi3Error;
 		}
 
-		v = instance->modelVariables[index];
+		record = &instance->variableRecords[index];
 
-		if (v.dtypeID != datatypeID) {
+		if (record->dtypeID != datatypeID) {
 			return fmi3Error;
 		}
 
-		if (copied + v.size > nValues) {
+		address = record->address;
+		size    = record->size;
+		nBytes  = record->nBytes;
+
+		/* coalesce the following value references that are stored contiguously */
+		while (record->isContiguous && i + 1 < nvr && vr[i + 1] == vr[i] + 1) {
+			i++;
+			record++;
+			size   += record->size;
+			nBytes += record->nBytes;
+		}
+
+		if (copied + size > nValues) {
 			return fmi3Error;
 		}
 
 		if (datatypeID == SS_BOOLEAN) {
-			for (j = 0; j < v.size; j++) {
-				((fmi3Boolean*)values)[j] = ((boolean_T *)v.address)[j] ? fmi3True : fmi3False;
-			}
-			values = (char *)values + (v.size * sizeof(fmi3Boolean));
+			getBooleans((fmi3Boolean *)values, (const BOOLEAN_T *)address, size);
+			values = (char *)values + (size * sizeof(fmi3Boolean));
 		} else {
-			memcpy(values, v.address, typeSize * v.size);
-			values = (char *)values + (v.size * typeSize);
+			memcpy(values, address, nBytes);
+			values = (char *)values + nBytes;
 		}
 		
-		copied += v.size;
+		copied += size;
 	}
 
 	return fmi3OK;
@@ -345,7 +625,7 @@ fmi3Status fmi3GetFloat32(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-	return getVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_SINGLE, sizeof(REAL32_T));
+	return getVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_SINGLE, sizeof(REAL32_T));
 }
 
 fmi3Status fmi3GetFloat64(fmi3Instance instance,
@@ -356,7 +636,7 @@ fmi3Status fmi3GetFloat64(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return getVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_DOUBLE, sizeof(REAL64_T));
+    return getVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_DOUBLE, sizeof(REAL64_T));
 }
 
 fmi3Status fmi3GetInt8(fmi3Instance instance,
@@ -367,7 +647,7 @@ fmi3Status fmi3GetInt8(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return getVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_INT8, sizeof(INT8_T));
+    return getVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_INT8, sizeof(INT8_T));
 }
 
 fmi3Status fmi3GetUInt8(fmi3Instance instance,
@@ -378,7 +658,7 @@ fmi3Status fmi3GetUInt8(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return getVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_UINT8, sizeof(UINT8_T));
+    return getVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_UINT8, sizeof(UINT8_T));
 }
 
 fmi3Status fmi3GetInt16(fmi3Instance instance,
@@ -389,7 +669,7 @@ fmi3Status fmi3GetInt16(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return getVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_INT16, sizeof(INT16_T));
+    return getVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_INT16, sizeof(INT16_T));
 }
 
 fmi3Status fmi3GetUInt16(fmi3Instance instance,
@@ -400,7 +680,7 @@ fmi3Status fmi3GetUInt16(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return getVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_UINT16, sizeof(UINT16_T));
+    return getVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_UINT16, sizeof(UINT16_T));
 }
 
 fmi3Status fmi3GetInt32(fmi3Instance instance,
@@ -411,7 +691,7 @@ fmi3Status fmi3GetInt32(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return getVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_INT32, sizeof(INT32_T));
+    return getVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_INT32, sizeof(INT32_T));
 }
 
 fmi3Status fmi3GetUInt32(fmi3Instance instance,
@@ -422,7 +702,7 @@ fmi3Status fmi3GetUInt32(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return getVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_UINT32, sizeof(UINT32_T));
+    return getVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_UINT32, sizeof(UINT32_T));
 }
 
 fmi3Status fmi3GetInt64(fmi3Instance instance,
@@ -444,7 +724,7 @@ fmi3Status fmi3GetInt64(fmi3Instance instance,
             return fmi3Error;
         }
 
-        v = &s_instance->modelVariables[index];
+        v = &modelInstance->modelVariables[index];
 
         if (v->dtypeID != SS_INT32) {
             return fmi3Error;
@@ -480,7 +760,7 @@ fmi3Status fmi3GetBoolean(fmi3Instance instance,
     fmi3Boolean values[],
     size_t nValues) {
     ASSERT_INSTANCE
-	return getVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_BOOLEAN, sizeof(BOOLEAN_T));
+	return getVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_BOOLEAN, sizeof(BOOLEAN_T));
 }
 
 fmi3Status fmi3GetString(fmi3Instance instance,
@@ -511,8 +791,11 @@ static fmi3Status setVariables(ModelInstance *instance,
 	const fmi3ValueReference vr[], size_t nvr,
 	const void *values, size_t nValues, BuiltInDTypeId datatypeID, size_t typeSize) {
 
-	size_t i, j, index, copied = 0;
-	ModelVariable v;
+	size_t i, index, size, nBytes, copied = 0;
+	const VariableRecord *record;
+	void *address;
+
+	UNUSED(typeSize);
 
 	for (i = 0; i < nvr; i++) {
 
@@ -522,28 +805,38 @@ static fmi3Status setVariables(ModelInstance *instance,
 			return fmi3Error;
 		}
 
-		v = instance->modelVariables[index];
+		record = &instance->variableRecords[index];
 
-		if (v.dtypeID != datatypeID) {
+		if (record->dtypeID != datatypeID) {
 			return fmi3Error;
 		}
 
-		if (copied + v.size > nValues) {
+		address = record->address;
+		size    = record->size;
+		nBytes  = record->nBytes;
+
+		/* coalesce the following value references that are stored contiguously */
+		while (record->isContiguous && i + 1 < nvr && vr[i + 1] == vr[i] + 1) {
+			i++;
+			record++;
+			size   += record->size;
+			nBytes += record->nBytes;
+		}
+
+		if (copied + size > nValues) {
 			return fmi3Error;
 		}
 
 		if (datatypeID == SS_BOOLEAN) {
-			for (j = 0; j < v.size; j++) {
-				((boolean_T *)v.address)[j] = ((fmi3Boolean*)values)[j] != fmi3False;
-			}
-			values = (char *)values + (v.size * sizeof(fmi3Boolean));
+			setBooleans((BOOLEAN_T *)address, (const fmi3Boolean *)values, size);
+			values = (const char *)values + (size * sizeof(fmi3Boolean));
 		}
 		else {
-			memcpy(v.address, values, typeSize * v.size);
-			values = (char *)values + (v.size * typeSize);
+			memcpy(address, values, nBytes);
+			values = (const char *)values + nBytes;
 		}
 
-		copied += v.size;
+		copied += size;
 	}
 
 	return fmi3OK;
@@ -557,7 +850,7 @@ fmi3Status fmi3SetFloat32(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return setVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_SINGLE, sizeof(REAL32_T));
+    return setVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_SINGLE, sizeof(REAL32_T));
 }
 
 fmi3Status fmi3SetFloat64(fmi3Instance instance,
@@ -568,7 +861,7 @@ fmi3Status fmi3SetFloat64(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return setVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_DOUBLE, sizeof(REAL64_T));
+    return setVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_DOUBLE, sizeof(REAL64_T));
 }
 
 fmi3Status fmi3SetInt8(fmi3Instance instance,
@@ -579,7 +872,7 @@ fmi3Status fmi3SetInt8(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return setVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_INT8, sizeof(INT8_T));
+    return setVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_INT8, sizeof(INT8_T));
 }
 
 fmi3Status fmi3SetUInt8(fmi3Instance instance,
@@ -590,7 +883,7 @@ fmi3Status fmi3SetUInt8(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return setVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_UINT8, sizeof(UINT8_T));
+    return setVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_UINT8, sizeof(UINT8_T));
 }
 
 fmi3Status fmi3SetInt16(fmi3Instance instance,
@@ -601,7 +894,7 @@ fmi3Status fmi3SetInt16(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return setVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_INT16, sizeof(INT16_T));
+    return setVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_INT16, sizeof(INT16_T));
 }
 
 fmi3Status fmi3SetUInt16(fmi3Instance instance,
@@ -612,7 +905,7 @@ fmi3Status fmi3SetUInt16(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return setVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_UINT16, sizeof(UINT16_T));
+    return setVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_UINT16, sizeof(UINT16_T));
 }
 
 fmi3Status fmi3SetInt32(fmi3Instance instance,
@@ -623,7 +916,7 @@ fmi3Status fmi3SetInt32(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return setVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_INT32, sizeof(INT32_T));
+    return setVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_INT32, sizeof(INT32_T));
 }
 
 fmi3Status fmi3SetUInt32(fmi3Instance instance,
@@ -634,7 +927,7 @@ fmi3Status fmi3SetUInt32(fmi3Instance instance,
 
     ASSERT_INSTANCE
 
-    return setVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_UINT32, sizeof(UINT32_T));
+    return setVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_UINT32, sizeof(UINT32_T));
 }
 
 fmi3Status fmi3SetInt64(fmi3Instance instance,
@@ -656,7 +949,7 @@ fmi3Status fmi3SetInt64(fmi3Instance instance,
             return fmi3Error;
         }
 
-        v = &s_instance->modelVariables[index];
+        v = &modelInstance->modelVariables[index];
 
         if (v->dtypeID != SS_INT32) {
             return fmi3Error;
@@ -692,7 +985,7 @@ fmi3Status fmi3SetBoolean(fmi3Instance instance,
     const fmi3Boolean values[],
     size_t nValues) {
     ASSERT_INSTANCE
-	return setVariables(s_instance, valueReferences, nValueReferences, values, nValues, SS_BOOLEAN, sizeof(BOOLEAN_T));
+	return setVariables(modelInstance, valueReferences, nValueReferences, values, nValues, SS_BOOLEAN, sizeof(BOOLEAN_T));
 }
 
 fmi3Status fmi3SetString(fmi3Instance instance,
@@ -738,35 +1031,120 @@ fmi3Status fmi3GetVariableDependencies(fmi3Instance instance,
 
 /* Getting and setting the internal FMU state */
 fmi3Status fmi3GetFMUState(fmi3Instance instance, fmi3FMUState* FMUState) {
-    NOT_IMPLEMENTED
+
+    ASSERT_INSTANCE
+
+    if (!modelInstance->S) {
+        logError(modelInstance, "The FMU has been terminated.");
+        return fmi3Error;
+    }
+
+    /* re-use a previously allocated state */
+    if (!*FMUState) {
+
+        *FMUState = malloc(stateSize(modelInstance));
+
+        if (!*FMUState) {
+            logError(modelInstance, RT_MEMORY_ALLOCATION_ERROR);
+            return fmi3Error;
+        }
+    }
+
+    getState(modelInstance, (ModelState *)*FMUState);
+
+    return fmi3OK;
 }
 
 fmi3Status fmi3SetFMUState(fmi3Instance instance, fmi3FMUState  FMUState) {
-    NOT_IMPLEMENTED
+
+    ASSERT_INSTANCE
+
+    if (!modelInstance->S || !FMUState || ((ModelState *)FMUState)->size != stateSize(modelInstance)) {
+        logError(modelInstance, "Invalid FMU state.");
+        return fmi3Error;
+    }
+
+    setState(modelInstance, (const ModelState *)FMUState);
+
+    return fmi3OK;
 }
 
 fmi3Status fmi3FreeFMUState(fmi3Instance instance, fmi3FMUState* FMUState) {
-    NOT_IMPLEMENTED
+
+    ASSERT_INSTANCE
+
+    if (FMUState) {
+        free(*FMUState);
+        *FMUState = NULL;
+    }
+
+    return fmi3OK;
 }
 
 fmi3Status fmi3SerializedFMUStateSize(fmi3Instance instance,
     fmi3FMUState  FMUState,
     size_t* size) {
-    NOT_IMPLEMENTED
+
+    ASSERT_INSTANCE
+
+    if (!FMUState) {
+        logError(modelInstance, "Invalid FMU state.");
+        return fmi3Error;
+    }
+
+    *size = ((ModelState *)FMUState)->size;
+
+    return fmi3OK;
 }
 
 fmi3Status fmi3SerializeFMUState(fmi3Instance instance,
     fmi3FMUState  FMUState,
     fmi3Byte serializedState[],
     size_t size) {
-    NOT_IMPLEMENTED
+
+    ASSERT_INSTANCE
+
+    if (!FMUState || size < ((ModelState *)FMUState)->size) {
+        logError(modelInstance, "The buffer for the serialized FMU state is too small.");
+        return fmi3Error;
+    }
+
+    memcpy(serializedState, FMUState, ((ModelState *)FMUState)->size);
+
+    return fmi3OK;
 }
 
 fmi3Status fmi3DeserializeFMUState(fmi3Instance instance,
     const fmi3Byte serializedState[],
     size_t size,
     fmi3FMUState* FMUState) {
-    NOT_IMPLEMENTED
+
+    ASSERT_INSTANCE
+
+    size_t serializedSize = 0;
+
+    if (size >= sizeof(size_t)) {
+        memcpy(&serializedSize, serializedState, sizeof(size_t));
+    }
+
+    if (size != stateSize(modelInstance) || serializedSize != size) {
+        logError(modelInstance, "The serialized FMU state does not match the FMU.");
+        return fmi3Error;
+    }
+
+    if (!*FMUState) {
+
+        *FMUState = malloc(size);
+
+        if (!*FMUState) {
+            logError(modelInstance, RT_MEMORY_ALLOCATION_ERROR);
+            return fmi3Error;
+        }
+    }
+
+    memcpy(*FMUState, serializedState, size);
+
+    return fmi3OK;
 }
 
 /* Getting partial derivatives */
@@ -810,7 +1188,24 @@ fmi3Status fmi3GetIntervalDecimal(fmi3Instance instance,
     size_t nValueReferences,
     fmi3Float64 intervals[],
     fmi3IntervalQualifier qualifiers[]) {
-    NOT_IMPLEMENTED
+
+    ASSERT_INSTANCE
+
+    for (size_t i = 0; i < nValueReferences; i++) {
+
+        const size_t index = valueReferences[i] - FIRST_CLOCK_VR;
+
+        if (index >= N_CLOCKS) {
+            logError(modelInstance, "Unknown clock.");
+            return fmi3Error;
+        }
+
+        /* the intervals of the tasks are constant */
+        intervals[i]  = clockIntervals[index];
+        qualifiers[i] = fmi3IntervalUnchanged;
+    }
+
+    return fmi3OK;
 }
 
 fmi3Status fmi3GetIntervalFraction(fmi3Instance instance,
@@ -826,7 +1221,22 @@ fmi3Status fmi3GetShiftDecimal(fmi3Instance instance,
     const fmi3ValueReference valueReferences[],
     size_t nValueReferences,
     fmi3Float64 shifts[]) {
-    NOT_IMPLEMENTED
+
+    ASSERT_INSTANCE
+
+    for (size_t i = 0; i < nValueReferences; i++) {
+
+        const size_t index = valueReferences[i] - FIRST_CLOCK_VR;
+
+        if (index >= N_CLOCKS) {
+            logError(modelInstance, "Unknown clock.");
+            return fmi3Error;
+        }
+
+        shifts[i] = clockShifts[index];
+    }
+
+    return fmi3OK;
 }
 
 fmi3Status fmi3GetShiftFraction(fmi3Instance instance,
@@ -974,25 +1384,58 @@ fmi3Status fmi3DoStep(fmi3Instance instance,
 
     UNUSED(noSetFMUStatePriorToCurrentPoint);
 
+    RT_MDL_TYPE *S = modelInstance->S;
+
     time_T tNext = currentCommunicationPoint + communicationStepSize;
 
+    *earlyReturn = fmi3False;
+
 #ifdef rtmGetT
-    double epsilon = (1.0 + fabs(rtmGetT(s_instance->S))) * 2 * DBL_EPSILON;
+    double epsilon = (1.0 + fabs(rtmGetT(S))) * 2 * DBL_EPSILON;
 
-    while (rtmGetT(s_instance->S) < tNext + epsilon)
+#if N_EVENT_OUTPUTS > 0
+    if (modelInstance->earlyReturnAllowed) {
+
+        updateEventValues(modelInstance);
+
+        /* return after the first step that changes an event output */
+        while (rtmGetT(S) < tNext + epsilon && !rtmGetErrorStatus(S)) {
+
+            doFixedStep(S);
+
+            if (updateEventValues(modelInstance) && rtmGetT(S) < tNext + epsilon) {
+                *earlyReturn = fmi3True;
+                break;
+            }
+        }
+    } else
 #endif
     {
-        doFixedStep(s_instance->S);
+        /* take all but the last of the base steps with rtmGetT(S) < tNext + epsilon in a
+           counted loop and leave the rounding at the communication point to the time check */
+        double steps = ceil((tNext + epsilon - rtmGetT(S)) / STEP_SIZE) - 1;
+        size_t nSteps = steps > 0 ? (size_t)steps : 0;
+
+        for (size_t i = 0; i < nSteps && !rtmGetErrorStatus(S); i++) {
+            doFixedStep(S);
+        }
 
-        CHECK_ERROR_STATUS
+        while (rtmGetT(S) < tNext + epsilon && !rtmGetErrorStatus(S)) {
+            doFixedStep(S);
+        }
     }
+#else
+    doFixedStep(S);
+#endif
+
+    CHECK_ERROR_STATUS
 
     *eventHandlingNeeded = fmi3False;
     *terminateSimulation = fmi3False;
-    *earlyReturn         = fmi3False;
 
+    /* the time the FMU has advanced to (also after an early return) */
 #ifdef rtmGetT
-    *lastSuccessfulTime = rtmGetT(s_instance->S);
+    *lastSuccessfulTime = rtmGetT(S);
 #else
     *lastSuccessfulTime = tNext;
 #endif
@@ -1004,8 +1447,99 @@ fmi3Status fmi3DoStep(fmi3Instance instance,
 Types for Functions for Scheduled Execution
 ****************************************************/
 
+static void lockPreemption(const ModelInstance *instance) {
+    if (instance->lockPreemption) {
+        instance->lockPreemption();
+    }
+}
+
+static void unlockPreemption(const ModelInstance *instance) {
+    if (instance->unlockPreemption) {
+        instance->unlockPreemption();
+    }
+}
+
 fmi3Status fmi3ActivateModelPartition(fmi3Instance instance,
     fmi3ValueReference clockReference,
     fmi3Float64 activationTime) {
-    NOT_IMPLEMENTED 
+
+    ASSERT_INSTANCE
+
+    const size_t index = clockReference - FIRST_CLOCK_VR;
+
+    if (!modelInstance->scheduledExecution || index >= N_CLOCKS) {
+        logError(modelInstance, "Unknown clock.");
+        return fmi3Error;
+    }
+
+    /* the activations have to be on the grid of the clock */
+    const double n = floor((activationTime - clockShifts[index]) / clockIntervals[index] + 0.5);
+
+    if (n < 0 || fabs(activationTime - clockShifts[index] - n * clockIntervals[index]) > 1e-6 * clockIntervals[index]) {
+        logError(modelInstance, "The activation time is not a tick of the clock.");
+        return fmi3Error;
+    }
+
+    const long tick = (long)floor(activationTime / STEP_SIZE + 0.5);
+
+#if NUM_TASKS > 1
+    const int tid = clockTaskIDs[index];
+#else
+    const int tid = 0;
+#endif
+
+    if (tid == 0) {
+
+        /* the model advances by one base step per activation */
+        if (tick != modelInstance->baseTick + 1) {
+            logError(modelInstance, "The base rate partition has to be activated at every tick of its clock.");
+            return fmi3Error;
+        }
+
+        lockPreemption(modelInstance);
+
+#if NUM_TASKS > 1
+        /* the counters of the rate transitions advance with the next base step so
+           that the slower partitions of the previous base step still see them */
+        if (modelInstance->baseTick >= 0) {
+            for (int i = FIRST_TASK_ID + 1; i < NUM_SAMPLE_TIMES; i++) {
+                if (++rtmTaskCounter(modelInstance->S, i) == rtmCounterLimit(modelInstance->S, i)) {
+                    rtmTaskCounter(modelInstance->S, i) = 0;
+                }
+            }
+        }
+#endif
+
+        modelInstance->baseTick = tick;
+
+        unlockPreemption(modelInstance);
+
+#if NUM_TASKS > 1
+        MODEL_STEP(modelInstance->S, 0);
+#else
+        MODEL_STEP(modelInstance->S);
+#endif
+
+    } else {
+
+#if NUM_TASKS > 1
+        lockPreemption(modelInstance);
+
+        const int isDue = tick == modelInstance->baseTick && rtmStepTask(modelInstance->S, tid);
+
+        unlockPreemption(modelInstance);
+
+        /* the rate transitions expect the base rate to be activated first */
+        if (!isDue) {
+            logError(modelInstance, "The model partition has to be activated after the base rate partition at the same time.");
+            return fmi3Error;
+        }
+
+        MODEL_STEP(modelInstance->S, tid);
+#endif
+    }
+
+    CHECK_ERROR_STATUS
+
+    return fmi3OK;
 }
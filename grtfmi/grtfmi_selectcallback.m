@@ -15,11 +15,15 @@ slConfigUISetEnabled(hDlg, hSrc, 'GenerateMakefile', false);
 % keep the *.rtw file
 slConfigUISetVal(hDlg, hSrc, 'RetainRTWFile', 'on');
 
-% Reusable functions are not supported in R2012b
+% "Reusable function" generates code that can be instantiated multiple times
 params = get_param(gcs ,'ObjectParameters');
 if isfield(params, 'CodeInterfacePackaging')
-    slConfigUISetVal(hDlg, hSrc, 'CodeInterfacePackaging', 'Nonreusable function');
-    slConfigUISetEnabled(hDlg, hSrc, 'CodeInterfacePackaging', false);
+    slConfigUISetEnabled(hDlg, hSrc, 'CodeInterfacePackaging', true);
+end
+
+% allocate the model data of each instance dynamically
+if isfield(params, 'GenerateAllocFcn')
+    slConfigUISetVal(hDlg, hSrc, 'GenerateAllocFcn', 'on');
 end
 
 % disable Mat file logging
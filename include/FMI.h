@@ -22,6 +22,13 @@ extern "C" {
 #define FMI_STATIC
 #endif
 
+/* compile with FMI_NO_LOGGING to remove the logging of FMI calls */
+#ifdef FMI_NO_LOGGING
+#define FMI_LOG_FUNCTION_CALLS(instance) false
+#else
+#define FMI_LOG_FUNCTION_CALLS(instance) ((instance)->logFunctionCall != NULL)
+#endif
+
 typedef enum {
     FMIOK,
     FMIWarning,
@@ -108,6 +115,24 @@ typedef void FMILogFunctionCall(FMIInstance *instance, FMIStatus status, const c
 
 typedef void FMILogMessage(FMIInstance *instance, FMIStatus status, const char *category, const char *message);
 
+/* ring buffer that records the FMI calls as binary records to be decoded by FMIFlushTrace() */
+typedef struct {
+
+    char *data;
+    size_t size;
+
+    size_t first;  // offset of the oldest record
+    size_t next;   // offset of the next record
+    size_t limit;  // end of the records before the wrap-around
+    bool wrapped;
+
+    size_t nRecords;
+    size_t nDiscarded;
+
+    FMILogFunctionCall *logFunctionCall;  // receives the decoded calls
+
+} FMITraceBuffer;
+
 struct FMIInstance_ {
 
     FMI1Functions *fmi1Functions;
@@ -125,6 +150,8 @@ struct FMIInstance_ {
     FMILogMessage      *logMessage;
     FMILogFunctionCall *logFunctionCall;
 
+    FMITraceBuffer *traceBuffer;
+
     double time;
 
     char* logMessageBuffer;
@@ -157,6 +184,13 @@ FMI_STATIC void FMIAppendToLogMessageBuffer(FMIInstance* instance, const char* f
 
 FMI_STATIC void FMIAppendArrayToLogMessageBuffer(FMIInstance* instance, const void* values, size_t nValues, const size_t sizes[], FMIVariableType variableType);
 
+FMI_STATIC FMIStatus FMIStartTrace(FMIInstance *instance, size_t size);
+
+FMI_STATIC bool FMITraceValues(FMIInstance *instance, const char *function, const char *valuesName, const char *sizeName, FMIStatus status,
+    const FMIValueReference valueReferences[], size_t nValueReferences, const void *values, size_t nValues, FMIVariableType variableType);
+
+FMI_STATIC void FMIFlushTrace(FMIInstance *instance);
+
 FMI_STATIC FMIStatus FMIURIToPath(const char *uri, char *path, const size_t pathLength);
 
 FMI_STATIC FMIStatus FMIPathToURI(const char *path, char *uri, const size_t uriLength);
@@ -0,0 +1,42 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "FMI.h"
+
+/* Sparse Jacobian in compressed sparse column (CSC) format that is computed with one directional
+   derivative per group of structurally orthogonal columns (colors) */
+typedef struct {
+
+    size_t nRows;
+    size_t nColumns;
+    size_t nnz;
+
+    /* sparsity pattern: the row indices of the entries of column j are rowIndices[columnStarts[j]..columnStarts[j + 1] - 1] */
+    size_t *rowIndices;
+    size_t *columnStarts;
+
+    /* the columns of color c are colorColumns[colorStarts[c]..colorStarts[c + 1] - 1] */
+    size_t nColors;
+    size_t *colorStarts;
+    size_t *colorColumns;
+
+    /* work arrays for the directional derivatives */
+    FMIValueReference *knowns;
+    FMIValueReference *unknowns;
+    double *seed;
+    double *sensitivity;
+
+} FMIJacobian;
+
+FMI_STATIC FMIJacobian *FMICreateJacobian(size_t nRows, size_t nColumns, const size_t rowIndices[], const size_t columnStarts[]);
+
+FMI_STATIC void FMIFreeJacobian(FMIJacobian *jacobian);
+
+FMI_STATIC FMIStatus FMIGetJacobian(FMIInstance *instance, FMIJacobian *jacobian, const FMIValueReference rowVRs[], const FMIValueReference columnVRs[], double values[]);
+
+#ifdef __cplusplus
+}  /* end of extern "C" { */
+#endif
@@ -210,6 +210,7 @@ fmi2Status fmi2EnterInitializationMode(fmi2Component c) {
 		}
 		sfcnOutputs(model->S,0);
 		_ssSetTimeOfLastOutput(model->S,model->S->mdlInfo->t[0]);
+		clearChangedVariables(model);
 		if (model->fixed_in_minor_step_offset_tid != -1) {
 			model->S->mdlInfo->sampleHits[model->fixed_in_minor_step_offset_tid] = 0;
 			if (SFCN_FMI_LOAD_MEX) {
@@ -242,7 +243,6 @@ fmi2Status fmi2ExitInitializationMode(fmi2Component c) {
 	}
 
 	model->shouldRecompute = fmi2True;
-	model->lastGetTime = -1.0;  /* to make sure that derivatives are computed in fmi2GetReal at t=0 */
 
 	logger(model, model->instanceName, fmi2OK, "", "Exit initialization mode, enter event mode\n");
 	return fmi2OK;
@@ -283,24 +283,45 @@ fmi2Status fmi2Reset(fmi2Component c) {
 
 /* Getting and setting variable values */
 
-// helper function to update the outputs and derivatives
-static void calculateOutputs(Model *model) {
+// helper function to update the outputs and derivatives if the time, the
+// continuous states or the inputs have changed since the last evaluation
+static void evaluateModel(Model *model) {
 
-	if (!model->isCoSim && !model->isDiscrete) {
+	if (model->shouldRecompute) {
 
-		if ((!isEqual(ssGetT(model->S), model->lastGetTime)) || model->shouldRecompute) {
+		sfcnOutputs(model->S, 0);
+		_ssSetTimeOfLastOutput(model->S, model->S->mdlInfo->t[0]);
 
-			sfcnOutputs(model->S, 0);
-			_ssSetTimeOfLastOutput(model->S, model->S->mdlInfo->t[0]);
+		if (ssGetmdlDerivatives(model->S) != NULL) {
+			sfcnDerivatives(model->S);
+		}
 
-			if (ssGetmdlDerivatives(model->S) != NULL) {
-				sfcnDerivatives(model->S);
-			}
+		model->S->mdlInfo->simTimeStep = MINOR_TIME_STEP;
+		model->shouldRecompute = 0;
+		clearChangedVariables(model);
+	}
+}
 
-			model->S->mdlInfo->simTimeStep = MINOR_TIME_STEP;
-			model->shouldRecompute = 0;
-			model->lastGetTime = ssGetT(model->S);
-		}
+// helper function to record that a variable has been set to a different value
+static void setChanged(Model *model, fmi2ValueReference vr) {
+	model->changedVariables[(vr - 1) / 32] |= 1U << ((vr - 1) % 32);
+	model->shouldRecompute = 1;
+}
+
+// assign the value to the model variable mv with value reference vr[i] if it has changed
+#define SET_VALUE(type, v) { \
+    type *p = (type *)mv->address; \
+    if (*p != (type)(v)) { \
+        *p = (type)(v); \
+        setChanged(model, vr[i]); \
+    } \
+}
+
+// helper function to update the outputs for fmi2Get{Real|Integer|Boolean}
+static void calculateOutputs(Model *model) {
+
+	if (!model->isCoSim && !model->isDiscrete) {
+		evaluateModel(model);
 	}
 }
 
@@ -431,24 +452,18 @@ fmi2Status fmi2SetReal(fmi2Component c, const fmi2ValueReference vr[], size_t nv
 
         ModelVariable *mv = &(model->modelVariables[vr[i] - 1]);
 
-        real_T *p;
-
         switch (mv->dtypeID) {
-        case SS_DOUBLE: {
-            p = (real_T *)mv->address;
-            *((real_T *)mv->address) = value[i];
-        }
-                        break;
+        case SS_DOUBLE:
+            SET_VALUE(real_T, value[i])
+            break;
         case SS_SINGLE:
-            *((real32_T *)mv->address) = value[i];
+            SET_VALUE(real32_T, value[i])
             break;
         default:
             return fmi2Error;
         }
     }
 
-    model->shouldRecompute = 1;
-
     return fmi2OK;
 }
 
@@ -466,30 +481,28 @@ fmi2Status fmi2SetInteger(fmi2Component c, const fmi2ValueReference vr[], size_t
 
         switch (mv->dtypeID) {
         case SS_INT8:
-            *((int8_T *)mv->address) = value[i];
+            SET_VALUE(int8_T, value[i])
             break;
         case SS_UINT8:
-            *((uint8_T *)mv->address) = value[i];
+            SET_VALUE(uint8_T, value[i])
             break;
         case SS_INT16:
-            *((int16_T *)mv->address) = value[i];
+            SET_VALUE(int16_T, value[i])
             break;
         case SS_UINT16:
-            *((uint16_T *)mv->address) = value[i];
+            SET_VALUE(uint16_T, value[i])
             break;
         case SS_INT32:
-            *((int32_T *)mv->address) = value[i];
+            SET_VALUE(int32_T, value[i])
             break;
         case SS_UINT32:
-            *((uint32_T *)mv->address) = value[i];
+            SET_VALUE(uint32_T, value[i])
             break;
         default:
             return fmi2Error;
         }
     }
 
-    model->shouldRecompute = 1;
-
     return fmi2OK;
 }
 
@@ -507,15 +520,13 @@ fmi2Status fmi2SetBoolean(fmi2Component c, const fmi2ValueReference vr[], size_t
 
         switch (mv->dtypeID) {
         case SS_BOOLEAN:
-            *((boolean_T *)mv->address) = value[i];
+            SET_VALUE(boolean_T, value[i])
             break;
         default:
             return fmi2Error;
         }
     }
 
-    model->shouldRecompute = 1;
-
     return fmi2OK;
 }
 
@@ -672,6 +683,7 @@ fmi2Status fmi2CompletedIntegratorStep(fmi2Component c, fmi2Boolean noSetFMUStat
 		}
 		sfcnOutputs(model->S, 0);
 		_ssSetTimeOfLastOutput(model->S,model->S->mdlInfo->t[0]);
+		clearChangedVariables(model);
 		if (ssGetmdlUpdate(model->S) != NULL) {
 #if defined(SFCN_FMI_VERBOSITY)
 			logger(model, model->instanceName, fmi2OK, "", "fmi2CompletedIntegratorStep: Calling mdlUpdate at time %.16f\n", ssGetT(model->S));
@@ -701,6 +713,7 @@ fmi2Status fmi2SetTime(fmi2Component c, fmi2Real time) {
 	if (model->fixed_in_minor_step_offset_tid != -1) {
 		model->S->mdlInfo->t[model->fixed_in_minor_step_offset_tid] = time;
 	}
+	model->shouldRecompute = fmi2True;
 	return fmi2OK;
 }
 
@@ -747,13 +760,10 @@ fmi2Status fmi2GetDerivatives(fmi2Component c, fmi2Real derivatives[], size_t nx
 		}
 	}
 
-	sfcnOutputs(model->S,0);
-	_ssSetTimeOfLastOutput(model->S,model->S->mdlInfo->t[0]);
+	evaluateModel(model);
 	if (ssGetmdlDerivatives(model->S) != NULL) {
-		sfcnDerivatives(model->S);
 		memcpy(derivatives, ssGetdX(model->S), nx * sizeof(fmi2Real));
 	}
-	model->S->mdlInfo->simTimeStep = MINOR_TIME_STEP;
 	return status;
 }
 
@@ -779,13 +789,11 @@ fmi2Status fmi2GetEventIndicators(fmi2Component c, fmi2Real eventIndicators[], s
 		}
 	}
 
-	sfcnOutputs(model->S,0);
-	_ssSetTimeOfLastOutput(model->S,model->S->mdlInfo->t[0]);
+	evaluateModel(model);
 	if (model->S->modelMethods.sFcn.mdlZeroCrossings != NULL) {
 		sfcnZeroCrossings(model->S);
 		memcpy(eventIndicators, model->S->mdlInfo->solverInfo->zcSignalVector, ni * sizeof(fmi2Real));
 	}
-	model->S->mdlInfo->simTimeStep = MINOR_TIME_STEP;
 	return status;
 }
 
@@ -951,6 +959,7 @@ fmi2Status fmi2DoStep(fmi2Component c, fmi2Real currentCommunicationPoint, fmi2R
     if (fabs(communicationStepSize) < SFCN_FMI_EPS) {
 		/* Zero step size; External event iteration, just recompute outputs */
 		sfcnOutputs(model->S, 0);
+		clearChangedVariables(model);
 		return status;
 	}
 
@@ -186,7 +186,7 @@ Model *InstantiateModel(const char* instanceName, logMessageCallback logMessage,
 	}
 
 	model->loggingOn          = 0;
-	model->shouldRecompute    = 0;
+	model->shouldRecompute    = 1;
 	model->time               = 0;
 	model->nbrSolverSteps     = 0;
 	model->isDiscrete         = 0;
@@ -792,7 +792,12 @@ int sfcn_fmi_load_mex(int nlhs, mxArray *plhs[], int nrhs, mxArray *prhs[], cons
         
 #endif // __APPLE__
 
-        
+
+/* Clear the changed variables after the outputs have been evaluated with their values */
+void clearChangedVariables(Model *model) {
+    memset(model->changedVariables, 0, sizeof(model->changedVariables));
+}
+
 void NewDiscreteStates(Model *model, int *valuesOfContinuousStatesChanged, real_T *nextT) {
     
     int i;
@@ -847,6 +852,7 @@ void NewDiscreteStates(Model *model, int *valuesOfContinuousStatesChanged, real_
         model->S->mdlInfo->simTimeStep = MAJOR_TIME_STEP;
         sfcnOutputs(model->S, 0);
         _ssSetTimeOfLastOutput(model->S,model->S->mdlInfo->t[0]);
+        clearChangedVariables(model);
         
         if (ssGetmdlUpdate(model->S) != NULL) {
 #if defined(SFCN_FMI_VERBOSITY)
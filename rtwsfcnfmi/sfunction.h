@@ -24,6 +24,10 @@
 #define ssGetNumContStatesPtr(S) &((S)->sizes.numContStates)
 #endif
 
+/* Bitset of the variables that have been changed by fmi2Set{Real|Integer|Boolean} since the last evaluation */
+#define SFCN_FMI_CHANGED_WORDS ((N_MODEL_VARIABLES + 31) / 32)
+#define SFCN_FMI_IS_CHANGED(model, vr) (((model)->changedVariables[((vr) - 1) / 32] >> (((vr) - 1) % 32)) & 1U)
+
 
 /* Model status */
 typedef enum {
@@ -60,8 +64,7 @@ struct Model_s {
 	int_T* numSampleHits;
 	int_T fixed_in_minor_step_offset_tid;
 	real_T nextHit_tid0;
-	real_T lastGetTime;
-	int shouldRecompute;
+	int shouldRecompute; /* the outputs and derivatives have to be evaluated */
 	int isCoSim;
 	int isDiscrete;
 	int hasEnteredContMode;
@@ -76,6 +79,7 @@ struct Model_s {
 	real_T* inputDerivatives;
 	real_T derivativeTime;
     ModelVariable modelVariables[N_MODEL_VARIABLES];
+    uint32_T changedVariables[SFCN_FMI_CHANGED_WORDS];
 };
 
 /* Function to copy per-task sample hits */
@@ -93,6 +97,7 @@ void resetSimStructVectors(SimStruct *S);
 void allocateSimStructVectors(Model* m);
 void setSampleStartValues(Model* m);
 void NewDiscreteStates(Model *model, int *valuesOfContinuousStatesChanged, real_T *nextT);
+void clearChangedVariables(Model *model);
 
 /* ODE solver functions */
 extern void rt_CreateIntegrationData(SimStruct *S);
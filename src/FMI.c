@@ -18,7 +18,36 @@
 #include "FMI.h"
 
 
-FMIInstance *FMICreateInstance(const char *instanceName, const char *libraryPath, FMILogMessage *logMessage, FMILogFunctionCall *logFunctionCall) {
+// loaded shared libraries, shared by the instances of the same FMU (not thread-safe: FMICreateInstance()
+// and FMIFreeInstance() must only be called on the main thread, also with the instantiation worker threads)
+typedef struct FMILibrary_ {
+
+    char *path;
+
+#ifdef _WIN32
+    HMODULE handle;
+#else
+    void *handle;
+#endif
+
+    size_t refCount;
+
+    struct FMILibrary_ *next;
+
+} FMILibrary;
+
+static FMILibrary *loadedLibraries = NULL;
+
+
+// load the shared library or increment the reference count if it has already been loaded
+static FMILibrary *acquireLibrary(const char *libraryPath) {
+
+    for (FMILibrary *library = loadedLibraries; library; library = library->next) {
+        if (!strcmp(library->path, libraryPath)) {
+            library->refCount++;
+            return library;
+        }
+    }
 
 # ifdef _WIN32
     TCHAR Buffer[1024];
@@ -54,9 +83,66 @@ FMIInstance *FMICreateInstance(const char *instanceName, const char *libraryPath
         return NULL;
     }
 
+    FMILibrary *library = (FMILibrary *)calloc(1, sizeof(FMILibrary));
+
+    if (!library) {
+# ifdef _WIN32
+        FreeLibrary(libraryHandle);
+# else
+        dlclose(libraryHandle);
+# endif
+        return NULL;
+    }
+
+    library->path     = strdup(libraryPath);
+    library->handle   = libraryHandle;
+    library->refCount = 1;
+    library->next     = loadedLibraries;
+
+    loadedLibraries = library;
+
+    return library;
+}
+
+// decrement the reference count and unload the shared library if it is no longer used
+static void releaseLibrary(FMIInstance *instance) {
+
+    FMILibrary **next = &loadedLibraries;
+
+    while (*next && (*next)->handle != instance->libraryHandle) {
+        next = &(*next)->next;
+    }
+
+    FMILibrary *library = *next;
+
+    if (library && --library->refCount > 0) {
+        return;
+    }
+
+# ifdef _WIN32
+    FreeLibrary(instance->libraryHandle);
+# else
+    dlclose(instance->libraryHandle);
+# endif
+
+    if (library) {
+        *next = library->next;
+        free(library->path);
+        free(library);
+    }
+}
+
+FMIInstance *FMICreateInstance(const char *instanceName, const char *libraryPath, FMILogMessage *logMessage, FMILogFunctionCall *logFunctionCall) {
+
+    FMILibrary *library = acquireLibrary(libraryPath);
+
+    if (!library) {
+        return NULL;
+    }
+
     FMIInstance* instance = (FMIInstance*)calloc(1, sizeof(FMIInstance));
 
-    instance->libraryHandle = libraryHandle;
+    instance->libraryHandle = library->handle;
 
     instance->logMessage = logMessage;
     instance->logFunctionCall = logFunctionCall;
@@ -80,14 +166,15 @@ void FMIFreeInstance(FMIInstance *instance) {
 
     // unload the shared library
     if (instance->libraryHandle) {
-# ifdef _WIN32
-        FreeLibrary(instance->libraryHandle);
-# else
-        dlclose(instance->libraryHandle);
-# endif
+        releaseLibrary(instance);
         instance->libraryHandle = NULL;
     }
 
+    if (instance->traceBuffer) {
+        free(instance->traceBuffer->data);
+        free(instance->traceBuffer);
+    }
+
     free(instance->logMessageBuffer);
 
     free((void*)instance->name);
@@ -246,6 +333,268 @@ void FMIAppendArrayToLogMessageBuffer(FMIInstance* instance, const void* values,
     }
 }
 
+typedef struct {
+    size_t size;              // size of the record in bytes
+    const char *function;     // name of the FMI function or NULL for text records
+    const char *valuesName;   // argument names for vectors or NULL for arrays
+    const char *sizeName;
+    FMIStatus status;
+    FMIVariableType variableType;
+    size_t nValueReferences;
+    size_t nValues;
+} FMITraceRecord;
+
+// round up to a multiple of sizeof(double) to keep the records and their values aligned
+#define TRACE_ALIGN(size) (((size) + sizeof(double) - 1) / sizeof(double) * sizeof(double))
+
+static size_t traceValueSize(FMIInstance *instance, FMIVariableType variableType) {
+    switch (variableType) {
+    case FMIFloat32Type:
+    case FMIDiscreteFloat32Type:
+        return sizeof(float);
+    case FMIFloat64Type:
+    case FMIDiscreteFloat64Type:
+        return sizeof(double);
+    case FMIInt8Type:
+    case FMIUInt8Type:
+        return sizeof(int8_t);
+    case FMIInt16Type:
+    case FMIUInt16Type:
+        return sizeof(int16_t);
+    case FMIInt32Type:
+    case FMIUInt32Type:
+        return sizeof(int32_t);
+    case FMIInt64Type:
+    case FMIUInt64Type:
+        return sizeof(int64_t);
+    case FMIBooleanType:
+        switch (instance->fmiVersion) {
+        case FMIVersion1: return sizeof(char);
+        case FMIVersion2: return sizeof(int);
+        default:          return sizeof(bool);
+        }
+    default:
+        return 0;  // not supported
+    }
+}
+
+static void evictTraceRecord(FMITraceBuffer *buffer) {
+
+    const FMITraceRecord *record = (const FMITraceRecord *)&buffer->data[buffer->first];
+
+    buffer->first += record->size;
+    buffer->nRecords--;
+    buffer->nDiscarded++;
+
+    if (buffer->wrapped && buffer->first >= buffer->limit) {
+        buffer->first = 0;
+        buffer->wrapped = false;
+    }
+}
+
+// reserve space for a record and discard the oldest records if necessary
+static FMITraceRecord *allocateTraceRecord(FMITraceBuffer *buffer, size_t size) {
+
+    // keep the records aligned
+    size = TRACE_ALIGN(size);
+
+    if (size > buffer->size) {
+        buffer->nDiscarded++;
+        return NULL;
+    }
+
+    if (buffer->next + size > buffer->size) {
+
+        // discard the records at the end of the buffer
+        while (buffer->wrapped) {
+            evictTraceRecord(buffer);
+        }
+
+        if (buffer->nRecords == 0) {
+            buffer->first = 0;
+        } else {
+            buffer->limit = buffer->next;
+            buffer->wrapped = true;
+        }
+
+        buffer->next = 0;
+    }
+
+    // discard the records that would be overwritten
+    while (buffer->wrapped && buffer->first < buffer->next + size) {
+        evictTraceRecord(buffer);
+    }
+
+    FMITraceRecord *record = (FMITraceRecord *)&buffer->data[buffer->next];
+
+    memset(record, 0, sizeof(FMITraceRecord));
+    record->size = size;
+
+    buffer->next += size;
+    buffer->nRecords++;
+
+    return record;
+}
+
+// replaces the logFunctionCall callback while tracing and records the message as text
+static void traceLogFunctionCall(FMIInstance *instance, FMIStatus status, const char *message) {
+
+    const size_t length = strlen(message) + 1;
+
+    FMITraceRecord *record = allocateTraceRecord(instance->traceBuffer, sizeof(FMITraceRecord) + length);
+
+    if (!record) {
+        return;
+    }
+
+    record->status = status;
+
+    memcpy(&record[1], message, length);
+}
+
+FMIStatus FMIStartTrace(FMIInstance *instance, size_t size) {
+
+    if (!instance->logFunctionCall || instance->traceBuffer) {
+        return FMIError;
+    }
+
+    FMITraceBuffer *buffer = (FMITraceBuffer *)calloc(1, sizeof(FMITraceBuffer));
+
+    if (!buffer) {
+        return FMIError;
+    }
+
+    buffer->data = (char *)malloc(size);
+
+    if (!buffer->data) {
+        free(buffer);
+        return FMIError;
+    }
+
+    buffer->size = size;
+    buffer->logFunctionCall = instance->logFunctionCall;
+
+    instance->traceBuffer = buffer;
+    instance->logFunctionCall = traceLogFunctionCall;
+
+    return FMIOK;
+}
+
+bool FMITraceValues(FMIInstance *instance, const char *function, const char *valuesName, const char *sizeName, FMIStatus status,
+    const FMIValueReference valueReferences[], size_t nValueReferences, const void *values, size_t nValues, FMIVariableType variableType) {
+
+    if (!instance->traceBuffer) {
+        return false;
+    }
+
+    const size_t valueSize = traceValueSize(instance, variableType);
+
+    if (valueSize == 0) {
+        return false;  // record as text
+    }
+
+    // the values start at an aligned offset after the value references
+    const size_t vrSize = TRACE_ALIGN(nValueReferences * sizeof(FMIValueReference));
+
+    FMITraceRecord *record = allocateTraceRecord(instance->traceBuffer, sizeof(FMITraceRecord) + vrSize + nValues * valueSize);
+
+    if (!record) {
+        return true;
+    }
+
+    record->function         = function;
+    record->valuesName       = valuesName;
+    record->sizeName         = sizeName;
+    record->status           = status;
+    record->variableType     = variableType;
+    record->nValueReferences = nValueReferences;
+    record->nValues          = nValues;
+
+    char *data = (char *)&record[1];
+
+    if (nValueReferences > 0) {
+        memcpy(data, valueReferences, nValueReferences * sizeof(FMIValueReference));
+    }
+
+    memcpy(&data[vrSize], values, nValues * valueSize);
+
+    return true;
+}
+
+static void decodeTraceRecord(FMIInstance *instance, const FMITraceRecord *record) {
+
+    FMILogFunctionCall *logFunctionCall = instance->traceBuffer->logFunctionCall;
+
+    const char *data = (const char *)&record[1];
+
+    if (!record->function) {
+        logFunctionCall(instance, record->status, data);
+        return;
+    }
+
+    const FMIValueReference *valueReferences = (const FMIValueReference *)data;
+    const void *values = &data[TRACE_ALIGN(record->nValueReferences * sizeof(FMIValueReference))];
+
+    FMIClearLogMessageBuffer(instance);
+
+    if (record->valuesName) {
+        FMIAppendToLogMessageBuffer(instance, "%s(%s={", record->function, record->valuesName);
+        FMIAppendArrayToLogMessageBuffer(instance, values, record->nValues, NULL, record->variableType);
+        FMIAppendToLogMessageBuffer(instance, "}, %s=%zu)", record->sizeName, record->nValues);
+    } else if (instance->fmiVersion == FMIVersion3) {
+        FMIAppendToLogMessageBuffer(instance, "%s(valueReferences={", record->function);
+        FMIAppendArrayToLogMessageBuffer(instance, valueReferences, record->nValueReferences, NULL, FMIValueReferenceType);
+        FMIAppendToLogMessageBuffer(instance, "}, nValueReferences=%zu, values={", record->nValueReferences);
+        FMIAppendArrayToLogMessageBuffer(instance, values, record->nValues, NULL, record->variableType);
+        FMIAppendToLogMessageBuffer(instance, "}, nValues=%zu)", record->nValues);
+    } else {
+        FMIAppendToLogMessageBuffer(instance, "%s(vr={", record->function);
+        FMIAppendArrayToLogMessageBuffer(instance, valueReferences, record->nValueReferences, NULL, FMIValueReferenceType);
+        FMIAppendToLogMessageBuffer(instance, "}, nvr=%zu, value={", record->nValueReferences);
+        FMIAppendArrayToLogMessageBuffer(instance, values, record->nValues, NULL, record->variableType);
+        FMIAppendToLogMessageBuffer(instance, "})");
+    }
+
+    logFunctionCall(instance, record->status, instance->logMessageBuffer);
+}
+
+void FMIFlushTrace(FMIInstance *instance) {
+
+    FMITraceBuffer *buffer = instance->traceBuffer;
+
+    if (!buffer) {
+        return;
+    }
+
+    if (buffer->nDiscarded > 0 && instance->logMessage) {
+        FMIClearLogMessageBuffer(instance);
+        FMIAppendToLogMessageBuffer(instance, "The trace buffer is full. %zu earlier FMI calls have been discarded.", buffer->nDiscarded);
+        instance->logMessage(instance, FMIWarning, "warning", instance->logMessageBuffer);
+    }
+
+    size_t position = buffer->first;
+
+    for (size_t i = 0; i < buffer->nRecords; i++) {
+
+        if (buffer->wrapped && position >= buffer->limit) {
+            position = 0;
+        }
+
+        const FMITraceRecord *record = (const FMITraceRecord *)&buffer->data[position];
+
+        decodeTraceRecord(instance, record);
+
+        position += record->size;
+    }
+
+    buffer->first      = 0;
+    buffer->next       = 0;
+    buffer->limit      = 0;
+    buffer->wrapped    = false;
+    buffer->nRecords   = 0;
+    buffer->nDiscarded = 0;
+}
+
 FMIStatus FMIURIToPath(const char *uri, char *path, const size_t pathLength) {
 
 #ifdef _WIN32
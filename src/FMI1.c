@@ -10,8 +10,15 @@
 #include "FMI1.h"
 
 
-// keep track of the current instance for the log callback
-static FMIInstance *currentInstance = NULL;
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// keep track of the current instance of the calling thread for the log callback
+// (the FMUs may be instantiated and stepped on worker threads)
+static THREAD_LOCAL FMIInstance *currentInstance = NULL;
 
 static void cb_logMessage1(fmi1Component c, fmi1String instanceName, fmi1Status status, fmi1String category, fmi1String message, ...) {
 
@@ -42,9 +49,11 @@ static void *loadSymbol(FMIInstance *instance, const char *prefix, const char *n
     void *addr = dlsym(instance->libraryHandle, fname);
 #endif
     if (!addr) {
-        FMIClearLogMessageBuffer(instance);
-        FMIAppendToLogMessageBuffer(instance, "Failed to load function \"%s\".", fname);
-        instance->logFunctionCall(instance, FMIError, instance->logMessageBuffer);
+        if (FMI_LOG_FUNCTION_CALLS(instance)) {
+            FMIClearLogMessageBuffer(instance);
+            FMIAppendToLogMessageBuffer(instance, "Failed to load function \"%s\".", fname);
+            instance->logFunctionCall(instance, FMIError, instance->logMessageBuffer);
+        }
     }
     return addr;
 }
@@ -62,7 +71,7 @@ do { \
 do { \
     currentInstance = instance; \
     FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1 ## f (instance->component); \
-    if (instance->logFunctionCall) { \
+    if (FMI_LOG_FUNCTION_CALLS(instance)) { \
         instance->logFunctionCall(instance, status, "fmi" #f "()"); \
     } \
     return status; \
@@ -72,7 +81,7 @@ do { \
 do { \
     currentInstance = instance; \
     FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1 ## f (instance->component, __VA_ARGS__); \
-    if (instance->logFunctionCall) { \
+    if (FMI_LOG_FUNCTION_CALLS(instance)) { \
         FMIClearLogMessageBuffer(instance); \
         FMIAppendToLogMessageBuffer(instance, "fmi" #f "(" m ")", __VA_ARGS__); \
         instance->logFunctionCall(instance, status, instance->logMessageBuffer); \
@@ -84,7 +93,7 @@ do { \
 do { \
     currentInstance = instance; \
     FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1 ## s ## t(instance->component, vr, nvr, value); \
-    if (instance->logFunctionCall) { \
+    if (FMI_LOG_FUNCTION_CALLS(instance) && !FMITraceValues(instance, "fmi" #s #t, NULL, NULL, status, vr, nvr, value, nvr, FMI ## t ## Type)) { \
         FMIClearLogMessageBuffer(instance); \
         FMIAppendToLogMessageBuffer(instance, "fmi" #s #t "(vr={"); \
         FMIAppendArrayToLogMessageBuffer(instance, vr, nvr, NULL, FMIValueReferenceType); \
@@ -143,7 +152,7 @@ FMIStatus FMI1SetDebugLogging(FMIInstance *instance, fmi1Boolean loggingOn) {
 
 const char* FMI1GetModelTypesPlatform(FMIInstance *instance) {
     currentInstance = instance;
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         instance->logFunctionCall(instance, FMIOK, "fmiGetModelTypesPlatform()");
     }
     return instance->fmi1Functions->fmi1GetModelTypesPlatform();
@@ -151,7 +160,7 @@ const char* FMI1GetModelTypesPlatform(FMIInstance *instance) {
 
 const char* FMI1GetVersion(FMIInstance *instance) {
     currentInstance = instance;
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         instance->logFunctionCall(instance, FMIOK, "fmiGetVersion()");
     }
     return instance->fmi1Functions->fmi1GetVersion();
@@ -214,7 +223,7 @@ FMIStatus FMI1InstantiateModel(FMIInstance *instance, fmi1String modelIdentifier
 
     status = instance->component ? FMIOK : FMIError;
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmiInstantiateModel(instanceName=\"%s\", GUID=\"%s\", functions=0x%p, loggingOn=%d)",
@@ -236,7 +245,7 @@ void FMI1FreeModelInstance(FMIInstance *instance) {
 
     instance->fmi1Functions->fmi1FreeModelInstance(instance->component);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         instance->logFunctionCall(instance, FMIOK, "fmiFreeModelInstance()");
     }
 }
@@ -251,7 +260,7 @@ FMIStatus FMI1SetContinuousStates(FMIInstance *instance, const fmi1Real x[], siz
 
     const FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1SetContinuousStates(instance->component, x, nx);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmiSetContinuousStates(x={");
         FMIAppendArrayToLogMessageBuffer(instance, x, nx, NULL, FMIRealType);
@@ -268,7 +277,7 @@ FMIStatus FMI1CompletedIntegratorStep(FMIInstance *instance, fmi1Boolean* callEv
 
     const FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1CompletedIntegratorStep(instance->component, callEventUpdate);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmiCompletedIntegratorStep(callEventUpdate=%d)", *callEventUpdate);
         instance->logFunctionCall(instance, status, instance->logMessageBuffer);
@@ -283,7 +292,7 @@ FMIStatus FMI1Initialize(FMIInstance *instance, fmi1Boolean toleranceControlled,
 
     const FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1Initialize(instance->component, toleranceControlled, relativeTolerance, eventInfo);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmiInitialize(toleranceControlled=%d, relativeTolerance=%.16g, eventInfo={iterationConverged=%d, stateValueReferencesChanged=%d, stateValuesChanged=%d, terminateSimulation=%d, upcomingTimeEvent=%d, nextEventTime=%.16g})",
@@ -300,7 +309,7 @@ FMIStatus FMI1GetDerivatives(FMIInstance *instance, fmi1Real derivatives[], size
 
     const FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1GetDerivatives(instance->component, derivatives, nx);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmiGetDerivatives(derivatives={");
         FMIAppendArrayToLogMessageBuffer(instance, derivatives, nx, NULL, FMIRealType);
@@ -317,7 +326,7 @@ FMIStatus FMI1GetEventIndicators(FMIInstance *instance, fmi1Real eventIndicators
 
     const FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1GetEventIndicators(instance->component, eventIndicators, ni);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmiGetEventIndicators(eventIndicators={");
         FMIAppendArrayToLogMessageBuffer(instance, eventIndicators, ni, NULL, FMIRealType);
@@ -334,7 +343,7 @@ FMIStatus FMI1EventUpdate(FMIInstance *instance, fmi1Boolean intermediateResults
 
     const FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1EventUpdate(instance->component, intermediateResults, eventInfo);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmiEventUpdate(intermediateResults=%d, eventInfo={iterationConverged=%d, stateValueReferencesChanged=%d, stateValuesChanged=%d, terminateSimulation=%d, upcomingTimeEvent=%d, nextEventTime=%.16g})",
@@ -351,7 +360,7 @@ FMIStatus FMI1GetContinuousStates(FMIInstance *instance, fmi1Real states[], size
 
     const FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1GetContinuousStates(instance->component, states, nx);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmiGetContinuousStates(states={");
         FMIAppendArrayToLogMessageBuffer(instance, states, nx, NULL, FMIRealType);
@@ -368,7 +377,7 @@ FMIStatus FMI1GetNominalContinuousStates(FMIInstance *instance, fmi1Real x_nomin
 
     const FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1GetNominalContinuousStates(instance->component, x_nominal, nx);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmiGetNominalContinuousStates(x_nominal={");
         FMIAppendArrayToLogMessageBuffer(instance, x_nominal, nx, NULL, FMIRealType);
@@ -385,7 +394,7 @@ FMIStatus FMI1GetStateValueReferences(FMIInstance *instance, fmi1ValueReference
 
     const FMIStatus status = (FMIStatus)instance->fmi1Functions->fmi1GetStateValueReferences(instance->component, vrx, nx);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmiGetStateValueReferences(vrx={");
         FMIAppendArrayToLogMessageBuffer(instance, vrx, nx, NULL, FMIValueReferenceType);
@@ -408,7 +417,7 @@ const char*   FMI1GetTypesPlatform(FMIInstance *instance) {
 
     currentInstance = instance;
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         instance->logFunctionCall(instance, FMIOK, "fmiGetTypesPlatform()");
     }
 
@@ -472,7 +481,7 @@ FMIStatus FMI1InstantiateSlave(FMIInstance *instance, fmi1String modelIdentifier
 
     status = instance->component ? FMIOK : FMIError;
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmiInstantiateSlave(instanceName=\"%s\", fmuGUID=\"%s\", fmuLocation=\"%s\", mimeType=\"%s\", timeout=%.16g, visible=%d, interactive=%d, functions=0x%p, loggingOn=%d)",
@@ -506,7 +515,7 @@ void FMI1FreeSlaveInstance(FMIInstance *instance) {
 
     instance->fmi1Functions->fmi1FreeSlaveInstance(instance->component);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         instance->logFunctionCall(instance, FMIOK, "fmiFreeSlaveInstance()");
     }
 }
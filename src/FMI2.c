@@ -64,7 +64,7 @@ do { \
 #define CALL(f) \
 do { \
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2 ## f (instance->component); \
-    if (instance->logFunctionCall) { \
+    if (FMI_LOG_FUNCTION_CALLS(instance)) { \
         instance->logFunctionCall(instance, status, "fmi2" #f "()"); \
     } \
     return status; \
@@ -73,7 +73,7 @@ do { \
 #define CALL_ARGS(f, m, ...) \
 do { \
     const FMIStatus status = (FMIStatus)instance->fmi2Functions-> fmi2 ## f (instance->component, __VA_ARGS__); \
-    if (instance->logFunctionCall) { \
+    if (FMI_LOG_FUNCTION_CALLS(instance)) { \
         FMIClearLogMessageBuffer(instance); \
         FMIAppendToLogMessageBuffer(instance, "fmi2" #f "(" m ")", __VA_ARGS__); \
         instance->logFunctionCall(instance, status, instance->logMessageBuffer); \
@@ -84,7 +84,7 @@ do { \
 #define CALL_ARRAY(s, t) \
 do { \
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2 ## s ## t(instance->component, vr, nvr, value); \
-    if (instance->logFunctionCall) { \
+    if (FMI_LOG_FUNCTION_CALLS(instance) && !FMITraceValues(instance, "fmi2" #s #t, NULL, NULL, status, vr, nvr, value, nvr, FMI ## t ## Type)) { \
         FMIClearLogMessageBuffer(instance); \
         FMIAppendToLogMessageBuffer(instance, "fmi2" #s #t "(vr={"); \
         FMIAppendArrayToLogMessageBuffer(instance, vr, nvr, NULL, FMIValueReferenceType); \
@@ -96,6 +96,19 @@ do { \
     return status; \
 } while (0)
 
+#define CALL_VECTOR(f, v, n) \
+do { \
+    const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2 ## f(instance->component, v, n); \
+    if (FMI_LOG_FUNCTION_CALLS(instance) && !FMITraceValues(instance, "fmi2" #f, #v, #n, status, NULL, 0, v, n, FMIRealType)) { \
+        FMIClearLogMessageBuffer(instance); \
+        FMIAppendToLogMessageBuffer(instance, "fmi2" #f "(" #v "={"); \
+        FMIAppendArrayToLogMessageBuffer(instance, v, n, NULL, FMIRealType); \
+        FMIAppendToLogMessageBuffer(instance, "}, " #n "=%zu)", n); \
+        instance->logFunctionCall(instance, status, instance->logMessageBuffer); \
+    } \
+    return status; \
+} while (0)
+
 /***************************************************
 Common Functions
 ****************************************************/
@@ -103,7 +116,7 @@ Common Functions
 /* Inquire version numbers of header files and setting logging status */
 const char* FMI2GetTypesPlatform(FMIInstance *instance) {
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         instance->logFunctionCall(instance, FMIOK, "fmi2GetTypesPlatform()");
     }
 
@@ -112,7 +125,7 @@ const char* FMI2GetTypesPlatform(FMIInstance *instance) {
 
 const char* FMI2GetVersion(FMIInstance *instance) {
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         instance->logFunctionCall(instance, FMIOK, "fmi2GetVersion()");
     }
 
@@ -123,7 +136,7 @@ FMIStatus FMI2SetDebugLogging(FMIInstance *instance, fmi2Boolean loggingOn, size
 
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2SetDebugLogging(instance->component, loggingOn, nCategories, categories);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi2SetDebugLogging(loggingOn=%d, nCategories=%zu, categories={");
         FMIAppendArrayToLogMessageBuffer(instance, categories, nCategories, NULL, FMIStringType);
@@ -235,7 +248,7 @@ FMIStatus FMI2Instantiate(FMIInstance *instance, const char *fmuResourceLocation
 
     instance->component = instance->fmi2Functions->fmi2Instantiate(instance->name, fmuType, fmuGUID, fmuResourceLocation, &instance->fmi2Functions->callbacks, visible, loggingOn);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         fmi2CallbackFunctions* f = &instance->fmi2Functions->callbacks;
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi2Instantiate(instanceName=\"%s\", fmuType=%d, fmuGUID=\"%s\", fmuResourceLocation=\"%s\", functions={logger=0x%p, allocateMemory=0x%p, freeMemory=0x%p, stepFinished=0x%p, componentEnvironment=0x%p}, visible=%d, loggingOn=%d)",
@@ -261,7 +274,7 @@ void FMI2FreeInstance(FMIInstance *instance) {
 
     instance->fmi2Functions->fmi2FreeInstance(instance->component);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         instance->logFunctionCall(instance, FMIOK, "fmi2FreeInstance()");
     }
 }
@@ -349,7 +362,7 @@ FMIStatus FMI2SerializedFMUstateSize(FMIInstance *instance, fmi2FMUstate  FMUsta
 
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2SerializedFMUstateSize(instance->component, FMUstate, size);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi2SerializedFMUstateSize(FMUstate=0x%p, size=%zu)", FMUstate, *size);
         instance->logFunctionCall(instance, status, instance->logMessageBuffer);
@@ -375,7 +388,7 @@ FMIStatus FMI2GetDirectionalDerivative(FMIInstance *instance,
 
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2GetDirectionalDerivative(instance->component, vUnknown_ref, nUnknown, vKnown_ref, nKnown, dvKnown, dvUnknown);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi2GetDirectionalDerivative(vUnknown_ref={");
         FMIAppendArrayToLogMessageBuffer(instance, vUnknown_ref, nUnknown, NULL, FMIValueReferenceType);
@@ -406,7 +419,7 @@ FMIStatus FMI2NewDiscreteStates(FMIInstance *instance, fmi2EventInfo *eventInfo)
 
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2NewDiscreteStates(instance->component, eventInfo);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmi2NewDiscreteStates(eventInfo={newDiscreteStatesNeeded=%d, terminateSimulation=%d, nominalsOfContinuousStatesChanged=%d, valuesOfContinuousStatesChanged=%d, nextEventTimeDefined=%d, nextEventTime=%.16g})",
@@ -429,7 +442,7 @@ FMIStatus FMI2CompletedIntegratorStep(FMIInstance *instance,
 
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2CompletedIntegratorStep(instance->component, noSetFMUStatePriorToCurrentPoint, enterEventMode, terminateSimulation);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmi2CompletedIntegratorStep(noSetFMUStatePriorToCurrentPoint=%d, enterEventMode=%d, terminateSimulation=%d)",
@@ -447,79 +460,24 @@ FMIStatus FMI2SetTime(FMIInstance* instance, fmi2Real time) {
 }
 
 FMIStatus FMI2SetContinuousStates(FMIInstance *instance, const fmi2Real x[], size_t nx) {
-
-    const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2SetContinuousStates(instance->component, x, nx);
-
-    if (instance->logFunctionCall) {
-        FMIClearLogMessageBuffer(instance);
-        FMIAppendToLogMessageBuffer(instance, "fmi2SetContinuousStates(x={");
-        FMIAppendArrayToLogMessageBuffer(instance, x, nx, NULL, FMIRealType);
-        FMIAppendToLogMessageBuffer(instance, "}, nx=%zu)", nx);
-        instance->logFunctionCall(instance, status, instance->logMessageBuffer);
-    }
-
-    return status;
+    CALL_VECTOR(SetContinuousStates, x, nx);
 }
 
 /* Evaluation of the model equations */
 FMIStatus FMI2GetDerivatives(FMIInstance *instance, fmi2Real derivatives[], size_t nx) {
-
-    const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2GetDerivatives(instance->component, derivatives, nx);
-
-    if (instance->logFunctionCall) {
-        FMIClearLogMessageBuffer(instance);
-        FMIAppendToLogMessageBuffer(instance, "fmi2GetDerivatives(derivatives={");
-        FMIAppendArrayToLogMessageBuffer(instance, derivatives, nx, NULL, FMIRealType);
-        FMIAppendToLogMessageBuffer(instance, "}, nx=%zu)", nx);
-        instance->logFunctionCall(instance, status, instance->logMessageBuffer);
-    }
-
-    return status;
+    CALL_VECTOR(GetDerivatives, derivatives, nx);
 }
 
 FMIStatus FMI2GetEventIndicators(FMIInstance *instance, fmi2Real eventIndicators[], size_t ni) {
-
-    const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2GetEventIndicators(instance->component, eventIndicators, ni);
-
-    if (instance->logFunctionCall) {
-        FMIClearLogMessageBuffer(instance);
-        FMIAppendToLogMessageBuffer(instance, "fmi2GetEventIndicators(eventIndicators={");
-        FMIAppendArrayToLogMessageBuffer(instance, eventIndicators, ni, NULL, FMIRealType);
-        FMIAppendToLogMessageBuffer(instance, "}, ni=%zu)", ni);
-        instance->logFunctionCall(instance, status, instance->logMessageBuffer);
-    }
-
-    return status;
+    CALL_VECTOR(GetEventIndicators, eventIndicators, ni);
 }
 
 FMIStatus FMI2GetContinuousStates(FMIInstance *instance, fmi2Real x[], size_t nx) {
-
-    const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2GetContinuousStates(instance->component, x, nx);
-
-    if (instance->logFunctionCall) {
-        FMIClearLogMessageBuffer(instance);
-        FMIAppendToLogMessageBuffer(instance, "fmi2GetContinuousStates(x={");
-        FMIAppendArrayToLogMessageBuffer(instance, x, nx, NULL, FMIRealType);
-        FMIAppendToLogMessageBuffer(instance, "}, nx=%zu)", nx);
-        instance->logFunctionCall(instance, status, instance->logMessageBuffer);
-    }
-
-    return status;
+    CALL_VECTOR(GetContinuousStates, x, nx);
 }
 
 FMIStatus FMI2GetNominalsOfContinuousStates(FMIInstance *instance, fmi2Real x_nominal[], size_t nx) {
-
-    const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2GetNominalsOfContinuousStates(instance->component, x_nominal, nx);
-
-    if (instance->logFunctionCall) {
-        FMIClearLogMessageBuffer(instance);
-        FMIAppendToLogMessageBuffer(instance, "fmi2GetNominalsOfContinuousStates(x_nominal={");
-        FMIAppendArrayToLogMessageBuffer(instance, x_nominal, nx, NULL, FMIRealType);
-        FMIAppendToLogMessageBuffer(instance, "}, nx=%zu)", nx);
-        instance->logFunctionCall(instance, status, instance->logMessageBuffer);
-    }
-
-    return status;
+    CALL_VECTOR(GetNominalsOfContinuousStates, x_nominal, nx);
 }
 
 /***************************************************
@@ -561,7 +519,7 @@ FMIStatus FMI2GetStatus(FMIInstance *instance, const fmi2StatusKind s, fmi2Statu
 
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2GetStatus(instance->component, s, value);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi2GetStatus(s=%d, value=%d)", s, *value);
         instance->logFunctionCall(instance, status, instance->logMessageBuffer);
@@ -574,7 +532,7 @@ FMIStatus FMI2GetRealStatus(FMIInstance *instance, const fmi2StatusKind s, fmi2R
 
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2GetRealStatus(instance->component, s, value);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi2GetRealStatus(s=%d, value=%.16g)", s, *value);
         instance->logFunctionCall(instance, status, instance->logMessageBuffer);
@@ -587,7 +545,7 @@ FMIStatus FMI2GetIntegerStatus(FMIInstance *instance, const fmi2StatusKind s, fm
 
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2GetIntegerStatus(instance->component, s, value);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi2GetIntegerStatus(s=%d, value=%d)", s, *value);
         instance->logFunctionCall(instance, status, instance->logMessageBuffer);
@@ -600,7 +558,7 @@ FMIStatus FMI2GetBooleanStatus(FMIInstance *instance, const fmi2StatusKind s, fm
 
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2GetBooleanStatus(instance->component, s, value);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi2GetBooleanStatus(s=%d, value=%d)", s, *value);
         instance->logFunctionCall(instance, status, instance->logMessageBuffer);
@@ -613,7 +571,7 @@ FMIStatus FMI2GetStringStatus(FMIInstance *instance, const fmi2StatusKind s, fmi
 
     const FMIStatus status = (FMIStatus)instance->fmi2Functions->fmi2GetStringStatus(instance->component, s, value);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi2GetStringStatus(s=%d, value=\"%s\")", s, *value);
         instance->logFunctionCall(instance, status, instance->logMessageBuffer);
@@ -626,3 +584,4 @@ FMIStatus FMI2GetStringStatus(FMIInstance *instance, const fmi2StatusKind s, fmi
 #undef CALL
 #undef CALL_ARGS
 #undef CALL_ARRAY
+#undef CALL_VECTOR
@@ -56,7 +56,7 @@ do { \
 #define CALL(f) \
 do { \
     const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3 ## f (instance->component); \
-    if (instance->logFunctionCall) { \
+    if (FMI_LOG_FUNCTION_CALLS(instance)) { \
         instance->logFunctionCall(instance, status, "fmi3" #f "()"); \
     } \
     instance->status = status > instance->status ? status : instance->status; \
@@ -66,7 +66,7 @@ do { \
 #define CALL_ARGS(f, m, ...) \
 do { \
     const FMIStatus status = (FMIStatus)instance->fmi3Functions-> fmi3 ## f (instance->component, __VA_ARGS__); \
-    if (instance->logFunctionCall) { \
+    if (FMI_LOG_FUNCTION_CALLS(instance)) { \
         FMIClearLogMessageBuffer(instance); \
         FMIAppendToLogMessageBuffer(instance, "fmi3" #f "(" m ")", __VA_ARGS__); \
         instance->logFunctionCall(instance, status, instance->logMessageBuffer); \
@@ -78,7 +78,7 @@ do { \
 #define CALL_ARRAY(s, t) \
 do { \
     const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3 ## s ## t(instance->component, valueReferences, nValueReferences, values, nValues); \
-    if (instance->logFunctionCall) { \
+    if (FMI_LOG_FUNCTION_CALLS(instance) && !FMITraceValues(instance, "fmi3" #s #t, NULL, NULL, status, valueReferences, nValueReferences, values, nValues, FMI ## t ## Type)) { \
         FMIClearLogMessageBuffer(instance); \
         FMIAppendToLogMessageBuffer(instance, "fmi3" #s #t "(valueReferences={"); \
         FMIAppendArrayToLogMessageBuffer(instance, valueReferences, nValueReferences, NULL, FMIValueReferenceType); \
@@ -91,13 +91,27 @@ do { \
     return status; \
 } while (0)
 
+#define CALL_VECTOR(f, v, n) \
+do { \
+    const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3 ## f(instance->component, v, n); \
+    if (FMI_LOG_FUNCTION_CALLS(instance) && !FMITraceValues(instance, "fmi3" #f, #v, #n, status, NULL, 0, v, n, FMIFloat64Type)) { \
+        FMIClearLogMessageBuffer(instance); \
+        FMIAppendToLogMessageBuffer(instance, "fmi3" #f "(" #v "={"); \
+        FMIAppendArrayToLogMessageBuffer(instance, v, n, NULL, FMIFloat64Type); \
+        FMIAppendToLogMessageBuffer(instance, "}, " #n "=%zu)", n); \
+        instance->logFunctionCall(instance, status, instance->logMessageBuffer); \
+    } \
+    instance->status = status > instance->status ? status : instance->status; \
+    return status; \
+} while (0)
+
 /***************************************************
 Types for Common Functions
 ****************************************************/
 
 /* Inquire version numbers and setting logging status */
 const char* FMI3GetVersion(FMIInstance *instance) {
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         instance->logFunctionCall(instance, FMIOK, "fmi3GetVersion()");
     }
     return instance->fmi3Functions->fmi3GetVersion();
@@ -110,7 +124,7 @@ FMIStatus FMI3SetDebugLogging(FMIInstance *instance,
 
     const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3SetDebugLogging(instance->component, loggingOn, nCategories, categories);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi3SetDebugLogging(loggingOn=%d, nCategories=%zu, categories={");
         FMIAppendArrayToLogMessageBuffer(instance, categories, nCategories, NULL, FMIStringType);
@@ -268,7 +282,7 @@ FMIStatus FMI3InstantiateModelExchange(
 
     instance->component = instance->fmi3Functions->fmi3InstantiateModelExchange(instance->name, instantiationToken, resourcePath, visible, loggingOn, instance, logMessage);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmi3InstantiateModelExchange("
@@ -333,7 +347,7 @@ FMIStatus FMI3InstantiateCoSimulation(
 
     instance->fmi3Functions->eventModeUsed = eventModeUsed;
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmi3InstantiateCoSimulation("
@@ -404,7 +418,7 @@ FMIStatus FMI3InstantiateScheduledExecution(
         lockPreemption,
         unlockPreemption);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmi3InstantiateScheduledExecution("
@@ -451,7 +465,7 @@ FMIStatus FMI3FreeInstance(FMIInstance *instance) {
 
     instance->component = NULL;
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         instance->logFunctionCall(instance, FMIOK, "fmi3FreeInstance()");
     }
 
@@ -605,7 +619,7 @@ FMIStatus FMI3GetBinary(FMIInstance *instance,
 
     const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3GetBinary(instance->component, valueReferences, nValueReferences, sizes, values, nValues);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi3GetBinary(valueReferences={");
         FMIAppendArrayToLogMessageBuffer(instance, valueReferences, nValueReferences, NULL, FMIValueReferenceType);
@@ -627,7 +641,7 @@ FMIStatus FMI3GetClock(FMIInstance *instance,
 
     const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3GetClock(instance->component, valueReferences, nValueReferences, values);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi3GetClock(valueReferences={");
         FMIAppendArrayToLogMessageBuffer(instance, valueReferences, nValueReferences, NULL, FMIValueReferenceType);
@@ -745,7 +759,7 @@ FMIStatus FMI3SetBinary(FMIInstance *instance,
 
     const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3SetBinary(instance->component, valueReferences, nValueReferences, sizes, values, nValues);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi3SetBinary(valueReferences={");
         FMIAppendArrayToLogMessageBuffer(instance, valueReferences, nValueReferences, NULL, FMIValueReferenceType);
@@ -767,7 +781,7 @@ FMIStatus FMI3SetClock(FMIInstance *instance,
 
     const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3SetClock(instance->component, valueReferences, nValueReferences, values);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi3SetClock(valueReferences={");
         FMIAppendArrayToLogMessageBuffer(instance, valueReferences, nValueReferences, NULL, FMIValueReferenceType);
@@ -818,7 +832,7 @@ FMIStatus FMI3SerializedFMUStateSize(FMIInstance *instance,
 
     const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3SerializedFMUStateSize(instance->component, FMUState, size);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance, "fmi3SerializedFMUStateSize(FMUState=0x%p, size=%zu)", FMUState, *size);
         instance->logFunctionCall(instance, status, instance->logMessageBuffer);
@@ -973,7 +987,7 @@ FMIStatus FMI3UpdateDiscreteStates(FMIInstance *instance,
 
     const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3UpdateDiscreteStates(instance->component, discreteStatesNeedUpdate, terminateSimulation, nominalsOfContinuousStatesChanged, valuesOfContinuousStatesChanged, nextEventTimeDefined, nextEventTime);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmi3UpdateDiscreteStates(discreteStatesNeedUpdate=%d, terminateSimulation=%d, nominalsOfContinuousStatesChanged=%d, valuesOfContinuousStatesChanged=%d, nextEventTimeDefined=%d, nextEventTime=%.16g)",
@@ -1000,7 +1014,7 @@ FMIStatus FMI3CompletedIntegratorStep(FMIInstance *instance,
 
     const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3CompletedIntegratorStep(instance->component, noSetFMUStatePriorToCurrentPoint, enterEventMode, terminateSimulation);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmi3CompletedIntegratorStep(noSetFMUStatePriorToCurrentPoint=%d, enterEventMode=%d, terminateSimulation=%d)",
@@ -1020,87 +1034,32 @@ FMIStatus FMI3SetTime(FMIInstance *instance, fmi3Float64 time) {
 FMIStatus FMI3SetContinuousStates(FMIInstance *instance,
     const fmi3Float64 continuousStates[],
     size_t nContinuousStates) {
-
-    const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3SetContinuousStates(instance->component, continuousStates, nContinuousStates);
-
-    if (instance->logFunctionCall) {
-        FMIClearLogMessageBuffer(instance);
-        FMIAppendToLogMessageBuffer(instance, "fmi3SetContinuousStates(continuousStates={");
-        FMIAppendArrayToLogMessageBuffer(instance, continuousStates, nContinuousStates, NULL, FMIFloat64Type);
-        FMIAppendToLogMessageBuffer(instance, "}, nContinuousStates=%zu)", nContinuousStates);
-        instance->logFunctionCall(instance, status, instance->logMessageBuffer);
-    }
-
-    return status;
+    CALL_VECTOR(SetContinuousStates, continuousStates, nContinuousStates);
 }
 
 /* Evaluation of the model equations */
 FMIStatus FMI3GetContinuousStateDerivatives(FMIInstance *instance,
     fmi3Float64 derivatives[],
     size_t nContinuousStates) {
-
-    const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3GetContinuousStateDerivatives(instance->component, derivatives, nContinuousStates);
-
-    if (instance->logFunctionCall) {
-        FMIClearLogMessageBuffer(instance);
-        FMIAppendToLogMessageBuffer(instance, "fmi3GetContinuousStateDerivatives(derivatives={");
-        FMIAppendArrayToLogMessageBuffer(instance, derivatives, nContinuousStates, NULL, FMIFloat64Type);
-        FMIAppendToLogMessageBuffer(instance, "}, nContinuousStates=%zu)", nContinuousStates);
-        instance->logFunctionCall(instance, status, instance->logMessageBuffer);
-    }
-
-    return status;
+    CALL_VECTOR(GetContinuousStateDerivatives, derivatives, nContinuousStates);
 }
 
 FMIStatus FMI3GetEventIndicators(FMIInstance *instance,
     fmi3Float64 eventIndicators[],
     size_t nEventIndicators) {
-
-    const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3GetEventIndicators(instance->component, eventIndicators, nEventIndicators);
-
-    if (instance->logFunctionCall) {
-        FMIClearLogMessageBuffer(instance);
-        FMIAppendToLogMessageBuffer(instance, "fmi3GetEventIndicators(eventIndicators={");
-        FMIAppendArrayToLogMessageBuffer(instance, eventIndicators, nEventIndicators, NULL, FMIFloat64Type);
-        FMIAppendToLogMessageBuffer(instance, "}, nEventIndicators=%zu)", nEventIndicators);
-        instance->logFunctionCall(instance, status, instance->logMessageBuffer);
-    }
-
-    return status;
+    CALL_VECTOR(GetEventIndicators, eventIndicators, nEventIndicators);
 }
 
 FMIStatus FMI3GetContinuousStates(FMIInstance *instance,
     fmi3Float64 continuousStates[],
     size_t nContinuousStates) {
-
-    const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3GetContinuousStates(instance->component, continuousStates, nContinuousStates);
-
-    if (instance->logFunctionCall) {
-        FMIClearLogMessageBuffer(instance);
-        FMIAppendToLogMessageBuffer(instance, "fmi3GetContinuousStates(continuousStates={");
-        FMIAppendArrayToLogMessageBuffer(instance, continuousStates, nContinuousStates, NULL, FMIFloat64Type);
-        FMIAppendToLogMessageBuffer(instance, "}, nContinuousStates=%zu)", nContinuousStates);
-        instance->logFunctionCall(instance, status, instance->logMessageBuffer);
-    }
-
-    return status;
+    CALL_VECTOR(GetContinuousStates, continuousStates, nContinuousStates);
 }
 
 FMIStatus FMI3GetNominalsOfContinuousStates(FMIInstance *instance,
     fmi3Float64 nominals[],
     size_t nContinuousStates) {
-
-    const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3GetNominalsOfContinuousStates(instance->component, nominals, nContinuousStates);
-
-    if (instance->logFunctionCall) {
-        FMIClearLogMessageBuffer(instance);
-        FMIAppendToLogMessageBuffer(instance, "fmi3GetNominalsOfContinuousStates(nominals={");
-        FMIAppendArrayToLogMessageBuffer(instance, nominals, nContinuousStates, NULL, FMIFloat64Type);
-        FMIAppendToLogMessageBuffer(instance, "}, nContinuousStates=%zu)", nContinuousStates);
-        instance->logFunctionCall(instance, status, instance->logMessageBuffer);
-    }
-
-    return status;
+    CALL_VECTOR(GetNominalsOfContinuousStates, nominals, nContinuousStates);
 }
 
 
@@ -1146,7 +1105,7 @@ FMIStatus FMI3DoStep(FMIInstance *instance,
 
     const FMIStatus status = (FMIStatus)instance->fmi3Functions->fmi3DoStep(instance->component, currentCommunicationPoint, communicationStepSize, noSetFMUStatePriorToCurrentPoint, eventEncountered, terminate, earlyReturn, lastSuccessfulTime);
 
-    if (instance->logFunctionCall) {
+    if (FMI_LOG_FUNCTION_CALLS(instance)) {
         FMIClearLogMessageBuffer(instance);
         FMIAppendToLogMessageBuffer(instance,
             "fmi3DoStep(currentCommunicationPoint=%.16g, communicationStepSize=%.16g, noSetFMUStatePriorToCurrentPoint=%d, eventEncountered=%d, terminate=%d, earlyReturn=%d, lastSuccessfulTime=%.16g)",
@@ -1171,3 +1130,4 @@ FMIStatus FMI3ActivateModelPartition(FMIInstance *instance,
 #undef CALL
 #undef CALL_ARGS
 #undef CALL_ARRAY
+#undef CALL_VECTOR
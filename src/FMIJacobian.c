@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "FMI2.h"
+#include "FMI3.h"
+#include "FMIJacobian.h"
+
+
+// greedy distance-2 coloring: columns that share a row get different colors
+static size_t colorColumns(const FMIJacobian *jacobian, size_t colors[]) {
+
+    const size_t nRows = jacobian->nRows;
+    const size_t nColumns = jacobian->nColumns;
+    const size_t nnz = jacobian->nnz;
+
+    size_t nColors = 0;
+
+    // columns of each row (transposed pattern)
+    size_t *rowStarts  = calloc(nRows + 1, sizeof(size_t));
+    size_t *rowColumns = calloc(nnz > 0 ? nnz : 1, sizeof(size_t));
+    size_t *forbidden  = calloc(nColumns > 0 ? nColumns : 1, sizeof(size_t));
+
+    if (!rowStarts || !rowColumns || !forbidden) {
+        nColors = SIZE_MAX;
+        goto TERMINATE;
+    }
+
+    for (size_t k = 0; k < nnz; k++) {
+        rowStarts[jacobian->rowIndices[k] + 1]++;
+    }
+
+    for (size_t i = 0; i < nRows; i++) {
+        rowStarts[i + 1] += rowStarts[i];
+    }
+
+    for (size_t j = 0; j < nColumns; j++) {
+        for (size_t k = jacobian->columnStarts[j]; k < jacobian->columnStarts[j + 1]; k++) {
+            const size_t i = jacobian->rowIndices[k];
+            rowColumns[rowStarts[i]++] = j;
+        }
+    }
+
+    // restore the row starts
+    for (size_t i = nRows; i > 0; i--) {
+        rowStarts[i] = rowStarts[i - 1];
+    }
+
+    rowStarts[0] = 0;
+
+    for (size_t j = 0; j < nColumns; j++) {
+        colors[j] = SIZE_MAX;
+    }
+
+    // forbidden[c] == j + 1 marks color c as used by a neighbor of column j
+    for (size_t j = 0; j < nColumns; j++) {
+
+        if (jacobian->columnStarts[j] == jacobian->columnStarts[j + 1]) {
+            continue;  // empty column
+        }
+
+        for (size_t k = jacobian->columnStarts[j]; k < jacobian->columnStarts[j + 1]; k++) {
+
+            const size_t i = jacobian->rowIndices[k];
+
+            for (size_t l = rowStarts[i]; l < rowStarts[i + 1]; l++) {
+
+                const size_t color = colors[rowColumns[l]];
+
+                if (color != SIZE_MAX) {
+                    forbidden[color] = j + 1;
+                }
+            }
+        }
+
+        size_t color = 0;
+
+        while (forbidden[color] == j + 1) {
+            color++;
+        }
+
+        colors[j] = color;
+
+        if (color + 1 > nColors) {
+            nColors = color + 1;
+        }
+    }
+
+TERMINATE:
+    free(rowStarts);
+    free(rowColumns);
+    free(forbidden);
+
+    return nColors;
+}
+
+FMIJacobian *FMICreateJacobian(size_t nRows, size_t nColumns, const size_t rowIndices[], const size_t columnStarts[]) {
+
+    size_t *colors = NULL;
+
+    FMIJacobian *jacobian = calloc(1, sizeof(FMIJacobian));
+
+    if (!jacobian) {
+        return NULL;
+    }
+
+    const size_t nnz = columnStarts[nColumns];
+
+    jacobian->nRows = nRows;
+    jacobian->nColumns = nColumns;
+    jacobian->nnz = nnz;
+
+    jacobian->rowIndices   = calloc(nnz > 0 ? nnz : 1, sizeof(size_t));
+    jacobian->columnStarts = calloc(nColumns + 1, sizeof(size_t));
+    jacobian->colorStarts  = calloc(nColumns + 1, sizeof(size_t));
+    jacobian->colorColumns = calloc(nColumns > 0 ? nColumns : 1, sizeof(size_t));
+    jacobian->knowns       = calloc(nColumns > 0 ? nColumns : 1, sizeof(FMIValueReference));
+    jacobian->unknowns     = calloc(nnz > 0 ? nnz : 1, sizeof(FMIValueReference));
+    jacobian->seed         = calloc(nColumns > 0 ? nColumns : 1, sizeof(double));
+    jacobian->sensitivity  = calloc(nnz > 0 ? nnz : 1, sizeof(double));
+
+    colors = calloc(nColumns > 0 ? nColumns : 1, sizeof(size_t));
+
+    if (!jacobian->rowIndices || !jacobian->columnStarts || !jacobian->colorStarts || !jacobian->colorColumns ||
+        !jacobian->knowns || !jacobian->unknowns || !jacobian->seed || !jacobian->sensitivity || !colors) {
+        goto FAIL;
+    }
+
+    for (size_t k = 0; k < nnz; k++) {
+        if (rowIndices[k] >= nRows) {
+            goto FAIL;
+        }
+        jacobian->rowIndices[k] = rowIndices[k];
+    }
+
+    for (size_t j = 0; j <= nColumns; j++) {
+        if (j > 0 && columnStarts[j] < columnStarts[j - 1]) {
+            goto FAIL;
+        }
+        jacobian->columnStarts[j] = columnStarts[j];
+    }
+
+    for (size_t j = 0; j < nColumns; j++) {
+        jacobian->seed[j] = 1;
+    }
+
+    jacobian->nColors = colorColumns(jacobian, colors);
+
+    if (jacobian->nColors == SIZE_MAX) {
+        goto FAIL;
+    }
+
+    // sort the columns by color
+    for (size_t j = 0; j < nColumns; j++) {
+        if (colors[j] != SIZE_MAX) {
+            jacobian->colorStarts[colors[j] + 1]++;
+        }
+    }
+
+    for (size_t c = 0; c < jacobian->nColors; c++) {
+        jacobian->colorStarts[c + 1] += jacobian->colorStarts[c];
+    }
+
+    for (size_t j = 0; j < nColumns; j++) {
+        if (colors[j] != SIZE_MAX) {
+            jacobian->colorColumns[jacobian->colorStarts[colors[j]]++] = j;
+        }
+    }
+
+    for (size_t c = jacobian->nColors; c > 0; c--) {
+        jacobian->colorStarts[c] = jacobian->colorStarts[c - 1];
+    }
+
+    jacobian->colorStarts[0] = 0;
+
+    free(colors);
+
+    return jacobian;
+
+FAIL:
+    free(colors);
+    FMIFreeJacobian(jacobian);
+
+    return NULL;
+}
+
+void FMIFreeJacobian(FMIJacobian *jacobian) {
+
+    if (!jacobian) {
+        return;
+    }
+
+    free(jacobian->rowIndices);
+    free(jacobian->columnStarts);
+    free(jacobian->colorStarts);
+    free(jacobian->colorColumns);
+    free(jacobian->knowns);
+    free(jacobian->unknowns);
+    free(jacobian->seed);
+    free(jacobian->sensitivity);
+    free(jacobian);
+}
+
+FMIStatus FMIGetJacobian(FMIInstance *instance, FMIJacobian *jacobian, const FMIValueReference rowVRs[], const FMIValueReference columnVRs[], double values[]) {
+
+    FMIStatus status = FMIOK;
+
+    for (size_t c = 0; c < jacobian->nColors; c++) {
+
+        size_t nKnowns = 0;
+        size_t nUnknowns = 0;
+
+        // the rows of the columns of one color are disjoint so the sensitivities of
+        // column j are the contiguous block that starts at the position of its first row
+        for (size_t l = jacobian->colorStarts[c]; l < jacobian->colorStarts[c + 1]; l++) {
+
+            const size_t j = jacobian->colorColumns[l];
+
+            jacobian->knowns[nKnowns++] = columnVRs[j];
+
+            for (size_t k = jacobian->columnStarts[j]; k < jacobian->columnStarts[j + 1]; k++) {
+                jacobian->unknowns[nUnknowns++] = rowVRs[jacobian->rowIndices[k]];
+            }
+        }
+
+        FMIStatus s;
+
+        if (instance->fmiVersion == FMIVersion2) {
+            s = FMI2GetDirectionalDerivative(instance, jacobian->unknowns, nUnknowns, jacobian->knowns, nKnowns, jacobian->seed, jacobian->sensitivity);
+        } else if (instance->fmiVersion == FMIVersion3) {
+            s = FMI3GetDirectionalDerivative(instance, jacobian->unknowns, nUnknowns, jacobian->knowns, nKnowns, jacobian->seed, nKnowns, jacobian->sensitivity, nUnknowns);
+        } else {
+            return FMIError;
+        }
+
+        if (s > status) {
+            status = s;
+        }
+
+        if (status > FMIWarning) {
+            return status;
+        }
+
+        const double *sensitivity = jacobian->sensitivity;
+
+        for (size_t l = jacobian->colorStarts[c]; l < jacobian->colorStarts[c + 1]; l++) {
+
+            const size_t j = jacobian->colorColumns[l];
+            const size_t n = jacobian->columnStarts[j + 1] - jacobian->columnStarts[j];
+
+            memcpy(&values[jacobian->columnStarts[j]], sensitivity, n * sizeof(double));
+
+            sensitivity += n;
+        }
+    }
+
+    return status;
+}
@@ -6,6 +6,11 @@
 
 #define FMI_MAX_MESSAGE_LENGTH 4096
 
+// size of the buffer for the binary trace of FMI calls (log FMI calls = 2)
+#ifndef FMI_TRACE_BUFFER_SIZE
+#define FMI_TRACE_BUFFER_SIZE (16 * 1024 * 1024)
+#endif
+
 #define INTERNET_MAX_URL_LENGTH 2083
 
 #ifdef GRTFMI
@@ -18,6 +23,7 @@ extern const char *FMU_RESOURCES_DIR;
 #include "FMI1.c"
 #include "FMI2.c"
 #include "FMI3.c"
+#include "FMIJacobian.c"
 
 #ifdef _WIN32
 
@@ -40,6 +46,63 @@ extern const char *FMU_RESOURCES_DIR;
 
 #include "simstruc.h"
 
+// compile with FMI_PARALLEL_INSTANTIATION to instantiate the FMUs on worker threads
+// and with FMI_PIPELINED_CO_SIMULATION to compute the co-simulation steps on worker threads
+#if defined(FMI_PARALLEL_INSTANTIATION) || defined(FMI_PIPELINED_CO_SIMULATION)
+#define FMI_WORKER_THREADS
+
+#include <math.h>
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Condition;
+#define THREAD_FUNCTION(name) static DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN return 0
+#define initMutex(m)    InitializeCriticalSection(m)
+#define destroyMutex(m) DeleteCriticalSection(m)
+#define lockMutex(m)    EnterCriticalSection(m)
+#define unlockMutex(m)  LeaveCriticalSection(m)
+#define initCondition(c)      InitializeConditionVariable(c)
+#define destroyCondition(c)
+#define waitCondition(c, m)   SleepConditionVariableCS(c, m, INFINITE)
+#define signalCondition(c)    WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+#define THREAD_FUNCTION(name) static void *name(void *arg)
+#define THREAD_RETURN return NULL
+#define initMutex(m)    pthread_mutex_init(m, NULL)
+#define destroyMutex(m) pthread_mutex_destroy(m)
+#define lockMutex(m)    pthread_mutex_lock(m)
+#define unlockMutex(m)  pthread_mutex_unlock(m)
+#define initCondition(c)      pthread_cond_init(c, NULL)
+#define destroyCondition(c)   pthread_cond_destroy(c)
+#define waitCondition(c, m)   pthread_cond_wait(c, m)
+#define signalCondition(c)    pthread_cond_broadcast(c)
+#endif
+
+#ifdef _WIN32
+#define startThread(t, f, a) ((*(t) = CreateThread(NULL, 0, f, a, 0, NULL)) != NULL)
+#define joinThread(t) (WaitForSingleObject(t, INFINITE), CloseHandle(t))
+#else
+#define startThread(t, f, a) (pthread_create(t, NULL, f, a) == 0)
+#define joinThread(t) pthread_join(t, NULL)
+#endif
+
+// messages logged while a worker thread uses the FMU
+typedef struct {
+    FMIStatus logLevel;  // log level of the block (captured before the worker thread starts)
+    Mutex mutex;
+    char *messages;
+    size_t size;
+    size_t length;
+} MessageBuffer;
+
+#endif /* FMI_PARALLEL_INSTANTIATION || FMI_PIPELINED_CO_SIMULATION */
+
 
 typedef enum {
 
@@ -65,10 +128,25 @@ typedef enum {
 	outputPortWidthsParam,
 	outputPortTypesParam,
 	outputPortVariableVRsParam,
+    continuousStateVRsParam,
+    derivativeVRsParam,
+    jacobianIrParam,
+    jacobianJcParam,
     numParams
 
 } Parameter;
 
+// blocks that were created before the Jacobian parameters (continuousStateVRsParam to jacobianJcParam)
+// were added have no such parameters and the tunable parameters start at continuousStateVRsParam
+static bool hasJacobianParams(SimStruct *S) {
+    return (ssGetSFcnParamsCount(S) - numParams) % 5 == 0;
+}
+
+// index of the first group of 5 parameters of a tunable parameter
+static int firstTunableParam(SimStruct *S) {
+    return hasJacobianParams(S) ? numParams : continuousStateVRsParam;
+}
+
 static size_t typeSizes[13] = {
     sizeof(real32_T),  //FMIFloat32Type,
     sizeof(real32_T),  //FMIDiscreteFloat32Type,
@@ -114,23 +192,71 @@ static char* getStringParam(SimStruct *S, int parameter, int index) {
 	return cstr; // must be mxFree()'d
 }
 
+// decoded block parameters, built in mdlStart() and mdlProcessParameters()
+typedef struct {
+
+    FMIVersion fmiVersion;
+    FMIInterfaceType interfaceType;
+
+    bool logFMICalls;
+    bool traceFMICalls;
+    FMIStatus logLevel;
+    double relativeTolerance;
+
+    int nx;
+    int nz;
+    bool resettable;
+
+    int nu;
+    int nuv;
+    int *inputPortWidths;
+    bool *inputPortDirectFeedThrough;
+    FMIVariableType *inputPortTypes;
+    FMIValueReference *inputPortVariableVRs;
+
+    int ny;
+    int nyv;
+    int *outputPortWidths;
+    FMIVariableType *outputPortTypes;
+    FMIValueReference *outputPortVariableVRs;
+
+} BlockConfig;
+
+// returns NULL if the block configuration has not been decoded yet
+static const BlockConfig *blockConfig(SimStruct *S) {
+
+    void **p = ssGetPWork(S);
+
+    return p ? (const BlockConfig *)p[5] : NULL;
+}
+
 static bool isFMI1(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->fmiVersion == FMIVersion1;
 	return mxGetScalar(ssGetSFcnParam(S, fmiVersionParam)) == 1.0;
 }
 
 static bool isFMI2(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->fmiVersion == FMIVersion2;
 	return mxGetScalar(ssGetSFcnParam(S, fmiVersionParam)) == 2.0;
 }
 
 static bool isFMI3(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->fmiVersion == FMIVersion3;
 	return mxGetScalar(ssGetSFcnParam(S, fmiVersionParam)) == 3.0;
 }
 
 static bool isME(SimStruct *S) { 
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->interfaceType == FMIModelExchange;
 	return mxGetScalar(ssGetSFcnParam(S, runAsKindParam)) == FMIModelExchange;
 }
 
 static bool isCS(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->interfaceType == FMICoSimulation;
 	return mxGetScalar(ssGetSFcnParam(S, runAsKindParam)) == FMICoSimulation;
 }
 
@@ -139,14 +265,27 @@ static bool debugLogging(SimStruct *S) {
 }
 
 static bool logFMICalls(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->logFMICalls;
     return mxGetScalar(ssGetSFcnParam(S, logFMICallsParam));
 }
 
+// record the FMI calls in a binary buffer and write them to the log in mdlTerminate()
+static bool traceFMICalls(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->traceFMICalls;
+    return mxGetScalar(ssGetSFcnParam(S, logFMICallsParam)) == 2;
+}
+
 static FMIStatus logLevel(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->logLevel;
     return (int)mxGetScalar(ssGetSFcnParam(S, logLevelParam));
 }
 
 static double relativeTolerance(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->relativeTolerance;
     return mxGetScalar(ssGetSFcnParam(S, relativeToleranceParam));
 }
 
@@ -160,35 +299,49 @@ static double offsetTime(SimStruct *S) {
 
 // number of continuous states
 static int nx(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->nx;
     return (int)mxGetScalar(ssGetSFcnParam(S, nxParam));
 }
 
 // number of zero-crossings
 static int nz(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->nz;
     return (int)mxGetScalar(ssGetSFcnParam(S, nzParam));
 }
 
 static bool resettable(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->resettable;
     return mxGetScalar(ssGetSFcnParam(S, resettableParam));
 }
 
 static int inputPortWidth(SimStruct *S, int index) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->inputPortWidths[index];
 	const real_T *portWidths = (const real_T *)mxGetData(ssGetSFcnParam(S, inputPortWidthsParam));
 	return (int)portWidths[index];
 }
 
 static bool inputPortDirectFeedThrough(SimStruct *S, int index) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->inputPortDirectFeedThrough[index];
 	const real_T *directFeedThrough = (const real_T *)mxGetData(ssGetSFcnParam(S, inputPortDirectFeedThroughParam));
 	return directFeedThrough[index] != 0;
 }
 
 // number of input ports
 static int nu(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->nu;
 	return (int)mxGetNumberOfElements(ssGetSFcnParam(S, inputPortWidthsParam));
 }
 
 // number of input variables
 static int nuv(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->nuv;
 	return (int)mxGetNumberOfElements(ssGetSFcnParam(S, inputPortVariableVRsParam));
 }
 
@@ -198,12 +351,18 @@ static int startValueSize(SimStruct *S, Parameter parameter, int index) {
 }
 
 static FMIValueReference valueReference(SimStruct *S, Parameter parameter, int index) {
+    const BlockConfig *config = blockConfig(S);
+    if (config && parameter == inputPortVariableVRsParam) return config->inputPortVariableVRs[index];
+    if (config && parameter == outputPortVariableVRsParam) return config->outputPortVariableVRs[index];
 	const mxArray *param = ssGetSFcnParam(S, parameter);
 	const real_T realValue = ((const real_T *)mxGetData(param))[index];
 	return (FMIValueReference)realValue;
 }
 
 static FMIVariableType variableType(SimStruct *S, Parameter parameter, int index) {
+    const BlockConfig *config = blockConfig(S);
+    if (config && parameter == inputPortTypesParam) return config->inputPortTypes[index];
+    if (config && parameter == outputPortTypesParam) return config->outputPortTypes[index];
 	const mxArray *param = ssGetSFcnParam(S, parameter);
 	const real_T realValue = ((const real_T *)mxGetData(param))[index];
 	const int intValue = (int)realValue;
@@ -253,14 +412,121 @@ static real_T scalarValue(SimStruct *S, Parameter parameter, size_t index) {
 }
 
 static int outputPortWidth(SimStruct *S, size_t index) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->outputPortWidths[index];
 	const real_T *portWidths = (const real_T *)mxGetData(ssGetSFcnParam(S, outputPortWidthsParam));
 	return (int)portWidths[index];
 }
 
 static int ny(SimStruct *S) { 
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->ny;
 	return (int)mxGetNumberOfElements(ssGetSFcnParam(S, outputPortWidthsParam));
 }
 
+// number of output variables
+static int nyv(SimStruct *S) {
+    const BlockConfig *config = blockConfig(S);
+    if (config) return config->nyv;
+	return (int)mxGetNumberOfElements(ssGetSFcnParam(S, outputPortVariableVRsParam));
+}
+
+// number of non-zero elements of the analytic Jacobian (0: no analytic Jacobian)
+static int jacobianNzMax(SimStruct *S) {
+
+    if (!isME(S) || !isFMI2(S) || !hasJacobianParams(S)) {
+        return 0;
+    }
+
+    const mxArray *jc = ssGetSFcnParam(S, jacobianJcParam);
+    const size_t n = mxGetNumberOfElements(jc);
+
+    if (n == 0) {
+        return 0;
+    }
+
+    return (int)((const real_T *)mxGetData(jc))[n - 1];
+}
+
+static void freeBlockConfig(BlockConfig *config) {
+
+    if (!config) {
+        return;
+    }
+
+    free(config->inputPortWidths);
+    free(config->inputPortDirectFeedThrough);
+    free(config->inputPortTypes);
+    free(config->inputPortVariableVRs);
+    free(config->outputPortWidths);
+    free(config->outputPortTypes);
+    free(config->outputPortVariableVRs);
+
+    free(config);
+}
+
+// decode the block parameters (the helpers above read the S-function parameters until the result is stored in PWork)
+static BlockConfig *createBlockConfig(SimStruct *S) {
+
+    BlockConfig *config = calloc(1, sizeof(BlockConfig));
+
+    config->fmiVersion        = (FMIVersion)(int)mxGetScalar(ssGetSFcnParam(S, fmiVersionParam));
+    config->interfaceType     = (FMIInterfaceType)(int)mxGetScalar(ssGetSFcnParam(S, runAsKindParam));
+    config->logFMICalls       = logFMICalls(S);
+    config->traceFMICalls     = traceFMICalls(S);
+    config->logLevel          = logLevel(S);
+    config->relativeTolerance = relativeTolerance(S);
+    config->nx                = nx(S);
+    config->nz                = nz(S);
+    config->resettable        = resettable(S);
+
+    config->nu  = nu(S);
+    config->nuv = nuv(S);
+
+    config->inputPortWidths            = calloc(config->nu, sizeof(int));
+    config->inputPortDirectFeedThrough = calloc(config->nu, sizeof(bool));
+    config->inputPortTypes             = calloc(config->nu, sizeof(FMIVariableType));
+    config->inputPortVariableVRs       = calloc(config->nuv, sizeof(FMIValueReference));
+
+    for (int i = 0; i < config->nu; i++) {
+        config->inputPortWidths[i]            = inputPortWidth(S, i);
+        config->inputPortDirectFeedThrough[i] = inputPortDirectFeedThrough(S, i);
+        config->inputPortTypes[i]             = variableType(S, inputPortTypesParam, i);
+    }
+
+    for (int i = 0; i < config->nuv; i++) {
+        config->inputPortVariableVRs[i] = valueReference(S, inputPortVariableVRsParam, i);
+    }
+
+    config->ny  = ny(S);
+    config->nyv = nyv(S);
+
+    config->outputPortWidths      = calloc(config->ny, sizeof(int));
+    config->outputPortTypes       = calloc(config->ny, sizeof(FMIVariableType));
+    config->outputPortVariableVRs = calloc(config->nyv, sizeof(FMIValueReference));
+
+    for (int i = 0; i < config->ny; i++) {
+        config->outputPortWidths[i] = outputPortWidth(S, i);
+        config->outputPortTypes[i]  = variableType(S, outputPortTypesParam, i);
+    }
+
+    for (int i = 0; i < config->nyv; i++) {
+        config->outputPortVariableVRs[i] = valueReference(S, outputPortVariableVRsParam, i);
+    }
+
+    return config;
+}
+
+static void updateBlockConfig(SimStruct *S) {
+
+    void **p = ssGetPWork(S);
+
+    freeBlockConfig((BlockConfig *)p[5]);
+
+    p[5] = NULL;  // read the S-function parameters
+    p[5] = createBlockConfig(S);
+}
+
 static bool initialized(SimStruct* S) {
 
 	void** p = ssGetPWork(S);
@@ -277,6 +543,139 @@ static bool initialized(SimStruct* S) {
 	}
 }
 
+// parameters of one type that are set in one call
+typedef struct {
+    size_t nValueReferences;
+    FMIValueReference *valueReferences;
+    size_t nValues;
+    void *values;
+} ParameterGroup;
+
+// arguments of the initialization of an FMU (collected from the SimStruct before the FMI calls)
+typedef struct {
+
+    double time;
+    double stopTime;  // can be -1
+    double relativeTolerance;
+
+    bool configure;  // set the structural parameters in Configuration Mode (FMI 3.0)
+    ParameterGroup structuralParameters[FMIStringType + 1];
+    ParameterGroup parameters[FMIStringType + 1];
+
+    const char *errorMessage;
+
+} Initialization;
+
+// arguments and result of the instantiation and initialization of an FMU
+typedef struct {
+
+    FMIInstance *instance;
+    FMIVersion fmiVersion;
+    FMIInterfaceType interfaceType;
+    bool loggingOn;
+
+    char *modelIdentifier;
+    char *guid;
+    char fmuResourceLocation[INTERNET_MAX_URL_LENGTH];
+
+    Initialization initialization;
+
+    FMIStatus status;
+
+#ifdef FMI_PARALLEL_INSTANTIATION
+    Thread thread;
+    MessageBuffer messages;
+#endif
+
+} Instantiation;
+
+// co-simulation step computed on a worker thread
+#ifdef FMI_PIPELINED_CO_SIMULATION
+typedef struct {
+
+    FMIInstance *instance;
+
+    Thread thread;
+    Mutex mutex;
+    Condition condition;
+
+    bool busy;  // a step is being computed
+    bool quit;
+
+    double currentCommunicationPoint;
+    double communicationStepSize;
+
+    FMIStatus status;
+
+    MessageBuffer messages;
+
+} Pipeline;
+#endif
+
+#ifdef FMI_WORKER_THREADS
+static void deferMessage(MessageBuffer *buffer, const char *message) {
+
+    const size_t length = strlen(message) + 1;
+
+    lockMutex(&buffer->mutex);
+
+    if (buffer->length + length > buffer->size) {
+
+        size_t size = buffer->size > 0 ? buffer->size : 1024;
+
+        while (size < buffer->length + length) {
+            size *= 2;
+        }
+
+        char *messages = realloc(buffer->messages, size);
+
+        if (!messages) {
+            unlockMutex(&buffer->mutex);
+            return;
+        }
+
+        buffer->messages = messages;
+        buffer->size = size;
+    }
+
+    memcpy(&buffer->messages[buffer->length], message, length);
+    buffer->length += length;
+
+    unlockMutex(&buffer->mutex);
+}
+
+// returns the buffer for the messages while a worker thread uses the FMU or NULL
+static MessageBuffer *deferredMessages(SimStruct *S) {
+
+    void **p = ssGetPWork(S);
+
+    if (!p) {
+        return NULL;
+    }
+
+#ifdef FMI_PARALLEL_INSTANTIATION
+    if (p[6]) {
+        return &((Instantiation *)p[6])->messages;
+    }
+#endif
+
+#ifdef FMI_PIPELINED_CO_SIMULATION
+    Pipeline *pipeline = (Pipeline *)p[7];
+
+    if (pipeline) {
+        lockMutex(&pipeline->mutex);
+        const bool busy = pipeline->busy;
+        unlockMutex(&pipeline->mutex);
+        if (busy) {
+            return &pipeline->messages;
+        }
+    }
+#endif
+
+    return NULL;
+}
+#endif
+
 static void logCall(SimStruct *S, const char* message) {
 
     FILE *logfile = NULL;
@@ -287,6 +686,15 @@ static void logCall(SimStruct *S, const char* message) {
         logfile = (FILE *)p[1];
     }
 
+#ifdef FMI_WORKER_THREADS
+    MessageBuffer *buffer = deferredMessages(S);
+
+    if (buffer) {
+        deferMessage(buffer, message);
+        return;
+    }
+#endif
+
     if (logfile) {
         fputs(message, logfile);
         fputs("\n", logfile);
@@ -297,6 +705,18 @@ static void logCall(SimStruct *S, const char* message) {
     }
 }
 
+#ifdef FMI_WORKER_THREADS
+// write the messages logged while the FMU was used by a worker thread
+static void writeDeferredMessages(SimStruct *S, MessageBuffer *buffer) {
+
+    for (size_t i = 0; i < buffer->length; i += strlen(&buffer->messages[i]) + 1) {
+        logCall(S, &buffer->messages[i]);
+    }
+
+    buffer->length = 0;
+}
+#endif
+
 static void appendStatus(FMIStatus status, char *message, size_t size) {
 	
 	const char *ret;
@@ -328,6 +748,14 @@ static void appendStatus(FMIStatus status, char *message, size_t size) {
 	strncat(message, ret, size);
 }
 
+// format a message of the FMU as "[<instance name>] <message> -> <status>"
+static void formatMessage(FMIInstance *instance, FMIStatus status, const char *message, char *buf) {
+
+	snprintf(buf, FMI_MAX_MESSAGE_LENGTH, "[%s] %s", instance->name, message);
+
+	appendStatus(status, buf, FMI_MAX_MESSAGE_LENGTH);
+}
+
 static void cb_logMessage(FMIInstance *instance, FMIStatus status, const char *category, const char * message) {
 	
 	SimStruct *S = (SimStruct *)instance->userData;
@@ -338,11 +766,7 @@ static void cb_logMessage(FMIInstance *instance, FMIStatus status, const char *c
 
 	char buf[FMI_MAX_MESSAGE_LENGTH];
 
-	size_t len = snprintf(buf, FMI_MAX_MESSAGE_LENGTH, "[%s] ", instance->name);
-
-	strncat(buf, message, FMI_MAX_MESSAGE_LENGTH);
-
-	appendStatus(status, buf, FMI_MAX_MESSAGE_LENGTH);
+	formatMessage(instance, status, message, buf);
 	
 	logCall(S, buf);
 }
@@ -351,15 +775,66 @@ static void cb_logFunctionCall(FMIInstance *instance, FMIStatus status, const ch
 	
 	char buf[FMI_MAX_MESSAGE_LENGTH];
 
-	snprintf(buf, FMI_MAX_MESSAGE_LENGTH, "[%s] %s", instance->name, message);
-
-	appendStatus(status, buf, FMI_MAX_MESSAGE_LENGTH);
+	formatMessage(instance, status, message, buf);
 
 	SimStruct *S = (SimStruct *)instance->userData;
 
 	logCall(S, buf);
 }
 
+#ifdef FMI_WORKER_THREADS
+// log callbacks while a worker thread uses the FMU (instance->userData is the MessageBuffer)
+static void cb_logMessageAsync(FMIInstance *instance, FMIStatus status, const char *category, const char * message) {
+
+	MessageBuffer *buffer = (MessageBuffer *)instance->userData;
+
+	if (status < buffer->logLevel) {
+		return;
+	}
+
+	char buf[FMI_MAX_MESSAGE_LENGTH];
+
+	formatMessage(instance, status, message, buf);
+
+	deferMessage(buffer, buf);
+}
+
+static void cb_logFunctionCallAsync(FMIInstance *instance, FMIStatus status, const char *message) {
+
+	MessageBuffer *buffer = (MessageBuffer *)instance->userData;
+
+	char buf[FMI_MAX_MESSAGE_LENGTH];
+
+	formatMessage(instance, status, message, buf);
+
+	deferMessage(buffer, buf);
+}
+
+// capture the log level and redirect the log callbacks before the instance is passed to a worker thread
+static void redirectLogging(SimStruct *S, FMIInstance *instance, MessageBuffer *buffer) {
+
+	buffer->logLevel = logLevel(S);
+
+	instance->userData = buffer;
+	instance->logMessage = cb_logMessageAsync;
+
+	if (instance->logFunctionCall == cb_logFunctionCall) {
+		instance->logFunctionCall = cb_logFunctionCallAsync;
+	}
+}
+
+// log through the SimStruct again after the worker thread has finished
+static void restoreLogging(SimStruct *S, FMIInstance *instance) {
+
+	instance->userData = S;
+	instance->logMessage = cb_logMessage;
+
+	if (instance->logFunctionCall == cb_logFunctionCallAsync) {
+		instance->logFunctionCall = cb_logFunctionCall;
+	}
+}
+#endif
+
 #ifdef _WIN32
 const char * exceptionCodeToString(DWORD exceptionCode) {
 	switch (exceptionCode) {
@@ -445,7 +920,7 @@ const char * exceptionCodeToString(DWORD exceptionCode) {
 /* log mdl*() and fmi*() calls */
 static void logDebug(SimStruct *S, const char* message, ...) {
 
-    if (logFMICalls(S)) {
+    if (logFMICalls(S) && !traceFMICalls(S)) {
 		
 		char buf[FMI_MAX_MESSAGE_LENGTH];
 		
@@ -469,469 +944,1088 @@ static void setErrorStatus(SimStruct *S, const char *message, ...) {
 	va_end(args);
 }
 
-static void setInput(SimStruct *S, bool direct, bool discrete, bool *inputEvent) {
+typedef struct {
 
-    *inputEvent = false;
+    size_t nVariables;
 
-	void **p = ssGetPWork(S);
+    FMIValueReference *valueReferences;  // value references of the variables
+    int *portIndices;                    // port indices of the variables
+    int *elementIndices;                 // element indices in the port signals
+    size_t *preValueOffsets;             // byte offsets in pre(u) (inputs only)
+    bool *directFeedThrough;             // direct feed through of the ports (inputs only)
 
-	FMIInstance *instance = (FMIInstance *)p[0];
-    const char *preU = p[3];
+    FMIValueReference *activeValueReferences;  // value references to set (inputs only)
+    void *values;                              // values to set or get
 
-	int iu  = 0;  // input port index
-    int ipu = 0;  // previous input index
+} IOGroup;
 
-	for (int i = 0; i < nu(S); i++) {
+typedef struct {
 
-		const int w = inputPortWidth(S, i);
-        
-        FMIVariableType type = variableType(S, inputPortTypesParam, i);
-        const size_t typeSize = typeSizes[type];
-        const bool discreteVariable = type != FMIFloat32Type && type != FMIFloat64Type;
+    // scalar input and output variables grouped by type (FMI 1.0 and 2.0)
+    IOGroup inputs[FMIBooleanType + 1];
+    IOGroup outputs[FMIBooleanType + 1];
 
-		if (direct && !inputPortDirectFeedThrough(S, i)) {
-			iu += w;
-            ipu += w * typeSize;
-			continue;
-		}
+    // conversion buffers of the input and output ports (FMI 3.0)
+    int nInputPorts;
+    int nOutputPorts;
+    void **inputBuffers;
+    void **outputBuffers;
 
-		const void *y = ssGetInputPortSignal(S, i);
+} IOPlan;
 
-		if (isFMI1(S) || isFMI2(S)) {
+static void freeIOGroup(IOGroup *group) {
+    free(group->valueReferences);
+    free(group->portIndices);
+    free(group->elementIndices);
+    free(group->preValueOffsets);
+    free(group->directFeedThrough);
+    free(group->activeValueReferences);
+    free(group->values);
+}
 
-			for (int j = 0; j < w; j++) {
+static void freeIOPlan(IOPlan *plan) {
 
-				const FMIValueReference vr = valueReference(S, inputPortVariableVRsParam, iu);
+    if (!plan) {
+        return;
+    }
 
-                const char *value = &((const char *)y)[j * typeSize];
-                char *preValue = &preU[ipu];
+    for (int i = 0; i <= FMIBooleanType; i++) {
+        freeIOGroup(&plan->inputs[i]);
+        freeIOGroup(&plan->outputs[i]);
+    }
 
-                ipu += typeSize;
+    if (plan->inputBuffers) {
+        for (int i = 0; i < plan->nInputPorts; i++) {
+            free(plan->inputBuffers[i]);
+        }
+        free(plan->inputBuffers);
+    }
 
-                if (memcmp(value, preValue, typeSize)) {
-                    if (!discreteVariable || (discreteVariable && discrete)) {
-                        memcpy(preValue, value, typeSize);
-                    }
-                    *inputEvent |= discreteVariable;
-                } else {
-                    iu++;
-                    continue;
-                }
+    if (plan->outputBuffers) {
+        for (int i = 0; i < plan->nOutputPorts; i++) {
+            free(plan->outputBuffers[i]);
+        }
+        free(plan->outputBuffers);
+    }
 
-				// set the input
-				if (isFMI1(S)) {
-
-					switch (type) {
-					case FMIRealType:
-						CHECK_STATUS(FMI1SetReal(instance, &vr, 1, &((const real_T *)y)[j]));
-						break;
-					case FMIIntegerType:
-						CHECK_STATUS(FMI1SetInteger(instance, &vr, 1, &((const int32_T *)y)[j]));
-						break;
-					case FMIBooleanType:
-						CHECK_STATUS(FMI1SetBoolean(instance, &vr, 1, &((const boolean_T *)y)[j]));
-						break;
-					default:
-						setErrorStatus(S, "Unsupported type id for FMI 1.0: %d", type);
-						return;
-					}
+    free(plan);
+}
 
-				} else {
+// buffer for the types that differ between Simulink and FMI 3.0
+static void *allocateConversionBuffer(FMIVariableType type, size_t nValues) {
+    switch (type) {
+    case FMIInt64Type:
+        return calloc(nValues, sizeof(fmi3Int64));
+    case FMIUInt64Type:
+        return calloc(nValues, sizeof(fmi3UInt64));
+    case FMIBooleanType:
+        return calloc(nValues, sizeof(fmi3Boolean));
+    default:
+        return NULL;
+    }
+}
 
-                    if (type == FMIRealType || (type == FMIDiscreteRealType && discrete)) {
-                        CHECK_STATUS(FMI2SetReal(instance, &vr, 1, (const fmi2Real *)value));
-                    } else if (type == FMIIntegerType && discrete) {
-                        CHECK_STATUS(FMI2SetInteger(instance, &vr, 1, (const int32_T *)value));
-                    } else if (type == FMIBooleanType && discrete) {
-                        const fmi2Boolean booleanValue = *value;
-                        CHECK_STATUS(FMI2SetBoolean(instance, &vr, 1, &booleanValue));
-                    } else {
-                        setErrorStatus(S, "Unsupported type id for FMI 2.0: %d", type);
-                        return;
-                    }
+static void allocateIOGroup(IOGroup *group, bool input) {
 
-				}
+    const size_t n = group->nVariables;
 
-				iu++;
-			}
+    if (n == 0) {
+        return;
+    }
 
-		} else {
+    group->valueReferences = calloc(n, sizeof(FMIValueReference));
+    group->portIndices     = calloc(n, sizeof(int));
+    group->elementIndices  = calloc(n, sizeof(int));
+    group->values          = calloc(n, sizeof(fmi2Real));  // large enough for all FMI 1.0 and 2.0 types
 
-            const size_t nValues = inputPortWidth(S, i);
-            const FMIValueReference vr = valueReference(S, inputPortVariableVRsParam, i);
+    if (input) {
+        group->preValueOffsets       = calloc(n, sizeof(size_t));
+        group->directFeedThrough     = calloc(n, sizeof(bool));
+        group->activeValueReferences = calloc(n, sizeof(FMIValueReference));
+    }
 
-            char *preValue = &preU[ipu];
+    group->nVariables = 0;  // incremented when the variables are added
+}
 
-            ipu += nValues * typeSize;
+static IOPlan *createIOPlan(SimStruct *S) {
 
-            if (memcmp(y, preValue, nValues * typeSize)) {
-                if (!discreteVariable || (discreteVariable && discrete)) {
-                    memcpy(preValue, y, nValues * typeSize);
-                }
-                *inputEvent |= discreteVariable;
-            } else {
-                continue;
-            }
+    IOPlan *plan = calloc(1, sizeof(IOPlan));
 
-			switch (type) {
-			case FMIFloat32Type:
-				CHECK_STATUS(FMI3SetFloat32(instance, &vr, 1, (const real32_T *)y, nValues));
-				break;
-			case FMIFloat64Type:
-				CHECK_STATUS(FMI3SetFloat64(instance, &vr, 1, (const real_T *)y, nValues));
-				break;
-			case FMIInt8Type:
-				CHECK_STATUS(FMI3SetInt8(instance, &vr, 1, (const int8_T *)y, nValues));
-				break;
-			case FMIUInt8Type:
-				CHECK_STATUS(FMI3SetUInt8(instance, &vr, 1, (const uint8_T *)y, nValues));
-				break;
-			case FMIInt16Type:
-				CHECK_STATUS(FMI3SetInt16(instance, &vr, 1, (const int16_T *)y, nValues));
-				break;
-			case FMIUInt16Type:
-				CHECK_STATUS(FMI3SetUInt16(instance, &vr, 1, (const uint16_T *)y, nValues));
-				break;
-			case FMIInt32Type:
-				CHECK_STATUS(FMI3SetInt32(instance, &vr, 1, (const int32_T *)y, nValues));
-				break;
-			case FMIUInt32Type:
-				CHECK_STATUS(FMI3SetUInt32(instance, &vr, 1, (const uint32_T *)y, nValues));
-				break;
-			case FMIInt64Type: {
-				fmi3Int64* values = (fmi3Int64*)calloc(nValues, sizeof(fmi3Int64));
-				for (int j = 0; j < nValues; j++) {
-					values[j] = ((const int32_T*)y)[j];
-				}
-				CHECK_STATUS(FMI3SetInt64(instance, &vr, 1, values, nValues));
-				free(values);
-				break;
-			}
-			case FMIUInt64Type: {
-				fmi3UInt64* values = (fmi3UInt64*)calloc(nValues, sizeof(fmi3UInt64));
-				for (int j = 0; j < nValues; j++) {
-					values[j] = ((const uint32_T*)y)[j];
-				}
-				CHECK_STATUS(FMI3SetUInt64(instance, &vr, 1, values, nValues));
-				free(values);
-				break;
-			}
-			case FMIBooleanType: {
-				fmi3Boolean *values = (fmi3Boolean *)calloc(nValues, sizeof(fmi3Boolean));
-				for (int j = 0; j < nValues; j++) {
-					 values[j] = ((const boolean_T*)y)[j];
-				}
-				CHECK_STATUS(FMI3SetBoolean(instance, &vr, 1, values, nValues));
-				free(values);
-				break;
-			}
-			default:
-				setErrorStatus(S, "Unsupported type id for FMI 3.0: %d", type);
-				return;
-			}
+    if (isFMI3(S)) {
 
-			iu++;
-		}
-	}
-}
+        plan->nInputPorts   = nu(S);
+        plan->nOutputPorts  = ny(S);
+        plan->inputBuffers  = calloc(nu(S), sizeof(void *));
+        plan->outputBuffers = calloc(ny(S), sizeof(void *));
 
-static void getOutput(SimStruct *S) {
+        for (int i = 0; i < nu(S); i++) {
+            plan->inputBuffers[i] = allocateConversionBuffer(variableType(S, inputPortTypesParam, i), inputPortWidth(S, i));
+        }
 
-	void **p = ssGetPWork(S);
+        for (int i = 0; i < ny(S); i++) {
+            plan->outputBuffers[i] = allocateConversionBuffer(variableType(S, outputPortTypesParam, i), outputPortWidth(S, i));
+        }
 
-	FMIInstance *instance = (FMIInstance *)p[0];
+        return plan;
+    }
 
-	int iy = 0;  // output port variable index
+    // count the variables
+    for (int i = 0; i < nu(S); i++) {
+        plan->inputs[variableType(S, inputPortTypesParam, i)].nVariables += inputPortWidth(S, i);
+    }
 
-	for (int i = 0; i < ny(S); i++) {
+    for (int i = 0; i < ny(S); i++) {
+        plan->outputs[variableType(S, outputPortTypesParam, i)].nVariables += outputPortWidth(S, i);
+    }
 
-		const FMIVariableType type = variableType(S, outputPortTypesParam, i);
+    for (int i = 0; i <= FMIBooleanType; i++) {
+        allocateIOGroup(&plan->inputs[i], true);
+        allocateIOGroup(&plan->outputs[i], false);
+    }
 
-		void *y = ssGetOutputPortSignal(S, i);
+    // add the variables
+    int iu = 0;      // input variable index
+    size_t ipu = 0;  // offset in pre(u)
 
-        if (isFMI1(S)) {
+    for (int i = 0; i < nu(S); i++) {
 
-            for (int j = 0; j < outputPortWidth(S, i); j++) {
+        const FMIVariableType type = variableType(S, inputPortTypesParam, i);
+        const bool directFeedThrough = inputPortDirectFeedThrough(S, i);
 
-                const FMIValueReference vr = valueReference(S, outputPortVariableVRsParam, iy);
+        IOGroup *group = &plan->inputs[type];
 
-                switch (type) {
-                case FMIRealType:
-                case FMIDiscreteRealType:
-                    CHECK_STATUS(FMI1GetReal(instance, &vr, 1, &((real_T *)y)[j]));
-                    break;
-                case FMIIntegerType:
-                    CHECK_STATUS(FMI1GetInteger(instance, &vr, 1, &((int32_T *)y)[j]));
-                    break;
-                case FMIBooleanType:
-                    CHECK_STATUS(FMI1GetBoolean(instance, &vr, 1, &((boolean_T *)y)[j]));
-                    break;
-                default:
-                    setErrorStatus(S, "Unsupported type id for FMI 1.0: %d", type);
-                    return;
+        for (int j = 0; j < inputPortWidth(S, i); j++) {
+            const size_t k = group->nVariables++;
+            group->valueReferences[k]   = valueReference(S, inputPortVariableVRsParam, iu++);
+            group->portIndices[k]       = i;
+            group->elementIndices[k]    = j;
+            group->preValueOffsets[k]   = ipu;
+            group->directFeedThrough[k] = directFeedThrough;
+            ipu += typeSizes[type];
+        }
+    }
+
+    int iy = 0;  // output variable index
+
+    for (int i = 0; i < ny(S); i++) {
+
+        IOGroup *group = &plan->outputs[variableType(S, outputPortTypesParam, i)];
+
+        for (int j = 0; j < outputPortWidth(S, i); j++) {
+            const size_t k = group->nVariables++;
+            group->valueReferences[k] = valueReference(S, outputPortVariableVRsParam, iy++);
+            group->portIndices[k]     = i;
+            group->elementIndices[k]  = j;
+        }
+    }
+
+    return plan;
+}
+
+/* element-wise conversion between Simulink and FMI 3.0 types */
+static void int32ToInt64(const int32_T *src, fmi3Int64 *dst, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = src[i];
+}
+
+static void uint32ToUInt64(const uint32_T *src, fmi3UInt64 *dst, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = src[i];
+}
+
+static void int64ToInt32(const fmi3Int64 *src, int32_T *dst, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = (int32_T)src[i];
+}
+
+static void uint64ToUInt32(const fmi3UInt64 *src, uint32_T *dst, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = (uint32_T)src[i];
+}
+
+static void booleanToFMI3Boolean(const boolean_T *src, fmi3Boolean *dst, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = src[i] != 0;
+}
+
+static void fmi3BooleanToBoolean(const fmi3Boolean *src, boolean_T *dst, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = src[i] ? 1 : 0;
+}
+
+static void setInput(SimStruct *S, bool direct, bool discrete, bool *inputEvent) {
+
+    *inputEvent = false;
+
+	void **p = ssGetPWork(S);
+
+	FMIInstance *instance = (FMIInstance *)p[0];
+    char *preU = p[3];
+    IOPlan *plan = (IOPlan *)p[4];
+
+    if (isFMI1(S) || isFMI2(S)) {
+
+        for (int t = 0; t <= FMIBooleanType; t++) {
+
+            IOGroup *group = &plan->inputs[t];
+
+            if (group->nVariables == 0) {
+                continue;
+            }
+
+            const FMIVariableType type = (FMIVariableType)t;
+            const size_t typeSize = typeSizes[type];
+            const bool discreteVariable = type != FMIFloat32Type && type != FMIFloat64Type;
+
+            // FMI 2.0 discrete variables can only be set in event mode
+            const bool setValues = isFMI1(S) || !discreteVariable || discrete;
+
+            size_t nValues = 0;
+
+            for (size_t j = 0; j < group->nVariables; j++) {
+
+                if (direct && !group->directFeedThrough[j]) {
+                    continue;
                 }
 
-                iy++;
+                const char *y = (const char *)ssGetInputPortSignal(S, group->portIndices[j]);
+                const char *value = &y[group->elementIndices[j] * typeSize];
+                char *preValue = &preU[group->preValueOffsets[j]];
+
+                if (!memcmp(value, preValue, typeSize)) {
+                    continue;
+                }
+
+                if (!discreteVariable || (discreteVariable && discrete)) {
+                    memcpy(preValue, value, typeSize);
+                }
+
+                *inputEvent |= discreteVariable;
+
+                if (!setValues) {
+                    continue;
+                }
+
+                group->activeValueReferences[nValues] = group->valueReferences[j];
+
+                switch (type) {
+                case FMIRealType:
+                case FMIDiscreteRealType:
+                    ((real_T *)group->values)[nValues] = *((const real_T *)value);
+                    break;
+                case FMIIntegerType:
+                    ((int32_T *)group->values)[nValues] = *((const int32_T *)value);
+                    break;
+                case FMIBooleanType:
+                    if (isFMI1(S)) {
+                        ((fmi1Boolean *)group->values)[nValues] = *((const boolean_T *)value);
+                    } else {
+                        ((fmi2Boolean *)group->values)[nValues] = *((const boolean_T *)value);
+                    }
+                    break;
+                default:
+                    break;
+                }
+
+                nValues++;
             }
 
-        } else if (isFMI2(S)) {
+            if (nValues == 0) {
+                continue;
+            }
 
-            for (int j = 0; j < outputPortWidth(S, i); j++) {
+            // set the inputs
+            const FMIValueReference *vr = group->activeValueReferences;
 
-                const FMIValueReference vr = valueReference(S, outputPortVariableVRsParam, iy);
+            if (isFMI1(S)) {
 
                 switch (type) {
                 case FMIRealType:
                 case FMIDiscreteRealType:
-                    CHECK_STATUS(FMI2GetReal(instance, &vr, 1, &((real_T *)y)[j]));
+                    CHECK_STATUS(FMI1SetReal(instance, vr, nValues, (const fmi1Real *)group->values));
                     break;
                 case FMIIntegerType:
-                    CHECK_STATUS(FMI2GetInteger(instance, &vr, 1, &((int32_T *)y)[j]));
+                    CHECK_STATUS(FMI1SetInteger(instance, vr, nValues, (const fmi1Integer *)group->values));
                     break;
-                case FMIBooleanType: {
-                    fmi2Boolean booleanValue;
-                    CHECK_STATUS(FMI2GetBoolean(instance, &vr, 1, &booleanValue));
-                    ((boolean_T *)y)[j] = booleanValue;
+                case FMIBooleanType:
+                    CHECK_STATUS(FMI1SetBoolean(instance, vr, nValues, (const fmi1Boolean *)group->values));
                     break;
+                default:
+                    setErrorStatus(S, "Unsupported type id for FMI 1.0: %d", type);
+                    return;
                 }
+
+            } else {
+
+                switch (type) {
+                case FMIRealType:
+                case FMIDiscreteRealType:
+                    CHECK_STATUS(FMI2SetReal(instance, vr, nValues, (const fmi2Real *)group->values));
+                    break;
+                case FMIIntegerType:
+                    CHECK_STATUS(FMI2SetInteger(instance, vr, nValues, (const fmi2Integer *)group->values));
+                    break;
+                case FMIBooleanType:
+                    CHECK_STATUS(FMI2SetBoolean(instance, vr, nValues, (const fmi2Boolean *)group->values));
+                    break;
                 default:
                     setErrorStatus(S, "Unsupported type id for FMI 2.0: %d", type);
                     return;
                 }
-            
-                iy++;
             }
+        }
 
-		} else {
+        return;
+    }
 
-			const size_t nValues = outputPortWidth(S, i);
-			const FMIValueReference vr = valueReference(S, outputPortVariableVRsParam, i);
-
-			switch (type) {
-            case FMIFloat32Type:
-            case FMIDiscreteFloat32Type:
-                CHECK_STATUS(FMI3GetFloat32(instance, &vr, 1, (real32_T *)y, nValues));
-				break;
-            case FMIFloat64Type:
-            case FMIDiscreteFloat64Type:
-                CHECK_STATUS(FMI3GetFloat64(instance, &vr, 1, (real_T *)y, nValues));
-				break;
-			case FMIInt8Type:
-				CHECK_STATUS(FMI3GetInt8(instance, &vr, 1, (int8_T *)y, nValues));
-				break;
-			case FMIUInt8Type:
-				CHECK_STATUS(FMI3GetUInt8(instance, &vr, 1, (uint8_T *)y, nValues));
-				break;
-			case FMIInt16Type:
-				CHECK_STATUS(FMI3GetInt16(instance, &vr, 1, (int16_T *)y, nValues));
-				break;
-			case FMIUInt16Type:
-				CHECK_STATUS(FMI3GetUInt16(instance, &vr, 1, (uint16_T *)y, nValues));
-				break;
-			case FMIInt32Type:
-				CHECK_STATUS(FMI3GetInt32(instance, &vr, 1, (int32_T *)y, nValues));
-				break;
-			case FMIUInt32Type:
-				CHECK_STATUS(FMI3GetUInt32(instance, &vr, 1, (uint32_T *)y, nValues));
-				break;
-			case FMIInt64Type: {
-				fmi3Int64* values = (fmi3Int64*)calloc(nValues, sizeof(fmi3Int64));
-				CHECK_STATUS(FMI3GetInt64(instance, &vr, 1, values, nValues));
-				for (int j = 0; j < nValues; j++) {
-					((int32_T*)y)[j] = values[j];
-				}
-				free(values);
-				break;
-			}
-			case FMIUInt64Type: {
-				fmi3UInt64* values = (fmi3UInt64*)calloc(nValues, sizeof(fmi3UInt64));
-				CHECK_STATUS(FMI3GetUInt64(instance, &vr, 1, values, nValues));
-				for (int j = 0; j < nValues; j++) {
-					((uint32_T*)y)[j] = values[j];
-				}
-				free(values);
-				break;
-			}
-			case FMIBooleanType: {
-				fmi3Boolean *values = (fmi3Boolean *)calloc(nValues, sizeof(fmi3Boolean));
-				CHECK_STATUS(FMI3GetBoolean(instance, &vr, 1, values, nValues));
-				for (int j = 0; j < nValues; j++) {
-					((boolean_T*)y)[j] = values[j];
-				}
-				free(values);
-				break;
-			}
-			default:
-				setErrorStatus(S, "Unsupported type id for FMI 3.0: %d", type);
-				return;
-			}
+	int ipu = 0;  // previous input index
+
+	for (int i = 0; i < nu(S); i++) {
+
+        FMIVariableType type = variableType(S, inputPortTypesParam, i);
+        const size_t typeSize = typeSizes[type];
+        const bool discreteVariable = type != FMIFloat32Type && type != FMIFloat64Type;
+
+		if (direct && !inputPortDirectFeedThrough(S, i)) {
+            ipu += inputPortWidth(S, i) * typeSize;
+			continue;
+		}
+
+		const void *y = ssGetInputPortSignal(S, i);
+
+        const size_t nValues = inputPortWidth(S, i);
+        const FMIValueReference vr = valueReference(S, inputPortVariableVRsParam, i);
+
+        char *preValue = &preU[ipu];
+
+        ipu += nValues * typeSize;
+
+        if (memcmp(y, preValue, nValues * typeSize)) {
+            if (!discreteVariable || (discreteVariable && discrete)) {
+                memcpy(preValue, y, nValues * typeSize);
+            }
+            *inputEvent |= discreteVariable;
+        } else {
+            continue;
+        }
+
+		switch (type) {
+		case FMIFloat32Type:
+			CHECK_STATUS(FMI3SetFloat32(instance, &vr, 1, (const real32_T *)y, nValues));
+			break;
+		case FMIFloat64Type:
+			CHECK_STATUS(FMI3SetFloat64(instance, &vr, 1, (const real_T *)y, nValues));
+			break;
+		case FMIInt8Type:
+			CHECK_STATUS(FMI3SetInt8(instance, &vr, 1, (const int8_T *)y, nValues));
+			break;
+		case FMIUInt8Type:
+			CHECK_STATUS(FMI3SetUInt8(instance, &vr, 1, (const uint8_T *)y, nValues));
+			break;
+		case FMIInt16Type:
+			CHECK_STATUS(FMI3SetInt16(instance, &vr, 1, (const int16_T *)y, nValues));
+			break;
+		case FMIUInt16Type:
+			CHECK_STATUS(FMI3SetUInt16(instance, &vr, 1, (const uint16_T *)y, nValues));
+			break;
+		case FMIInt32Type:
+			CHECK_STATUS(FMI3SetInt32(instance, &vr, 1, (const int32_T *)y, nValues));
+			break;
+		case FMIUInt32Type:
+			CHECK_STATUS(FMI3SetUInt32(instance, &vr, 1, (const uint32_T *)y, nValues));
+			break;
+		case FMIInt64Type: {
+			fmi3Int64 *values = (fmi3Int64 *)plan->inputBuffers[i];
+			int32ToInt64((const int32_T *)y, values, nValues);
+			CHECK_STATUS(FMI3SetInt64(instance, &vr, 1, values, nValues));
+			break;
+		}
+		case FMIUInt64Type: {
+			fmi3UInt64 *values = (fmi3UInt64 *)plan->inputBuffers[i];
+			uint32ToUInt64((const uint32_T *)y, values, nValues);
+			CHECK_STATUS(FMI3SetUInt64(instance, &vr, 1, values, nValues));
+			break;
+		}
+		case FMIBooleanType: {
+			fmi3Boolean *values = (fmi3Boolean *)plan->inputBuffers[i];
+			booleanToFMI3Boolean((const boolean_T *)y, values, nValues);
+			CHECK_STATUS(FMI3SetBoolean(instance, &vr, 1, values, nValues));
+			break;
+		}
+		default:
+			setErrorStatus(S, "Unsupported type id for FMI 3.0: %d", type);
+			return;
 		}
 	}
 }
 
+static void getOutput(SimStruct *S) {
+
+	void **p = ssGetPWork(S);
 
-// all, only structural, only tunable
-static void setParameters(SimStruct *S, bool structuralOnly, bool tunableOnly) {
+	FMIInstance *instance = (FMIInstance *)p[0];
+    IOPlan *plan = (IOPlan *)p[4];
+
+    if (isFMI1(S) || isFMI2(S)) {
+
+        for (int t = 0; t <= FMIBooleanType; t++) {
+
+            IOGroup *group = &plan->outputs[t];
+
+            if (group->nVariables == 0) {
+                continue;
+            }
+
+            const FMIVariableType type = (FMIVariableType)t;
+            const FMIValueReference *vr = group->valueReferences;
+            const size_t nValues = group->nVariables;
+
+            // get the outputs
+            if (isFMI1(S)) {
+
+                switch (type) {
+                case FMIRealType:
+                case FMIDiscreteRealType:
+                    CHECK_STATUS(FMI1GetReal(instance, vr, nValues, (fmi1Real *)group->values));
+                    break;
+                case FMIIntegerType:
+                    CHECK_STATUS(FMI1GetInteger(instance, vr, nValues, (fmi1Integer *)group->values));
+                    break;
+                case FMIBooleanType:
+                    CHECK_STATUS(FMI1GetBoolean(instance, vr, nValues, (fmi1Boolean *)group->values));
+                    break;
+                default:
+                    setErrorStatus(S, "Unsupported type id for FMI 1.0: %d", type);
+                    return;
+                }
+
+            } else {
+
+                switch (type) {
+                case FMIRealType:
+                case FMIDiscreteRealType:
+                    CHECK_STATUS(FMI2GetReal(instance, vr, nValues, (fmi2Real *)group->values));
+                    break;
+                case FMIIntegerType:
+                    CHECK_STATUS(FMI2GetInteger(instance, vr, nValues, (fmi2Integer *)group->values));
+                    break;
+                case FMIBooleanType:
+                    CHECK_STATUS(FMI2GetBoolean(instance, vr, nValues, (fmi2Boolean *)group->values));
+                    break;
+                default:
+                    setErrorStatus(S, "Unsupported type id for FMI 2.0: %d", type);
+                    return;
+                }
+            }
+
+            // copy the values to the output ports
+            for (size_t j = 0; j < nValues; j++) {
+
+                void *y = ssGetOutputPortSignal(S, group->portIndices[j]);
+                const int k = group->elementIndices[j];
+
+                switch (type) {
+                case FMIRealType:
+                case FMIDiscreteRealType:
+                    ((real_T *)y)[k] = ((const real_T *)group->values)[j];
+                    break;
+                case FMIIntegerType:
+                    ((int32_T *)y)[k] = ((const int32_T *)group->values)[j];
+                    break;
+                case FMIBooleanType:
+                    if (isFMI1(S)) {
+                        ((boolean_T *)y)[k] = ((const fmi1Boolean *)group->values)[j];
+                    } else {
+                        ((boolean_T *)y)[k] = ((const fmi2Boolean *)group->values)[j];
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+
+        return;
+    }
+
+	for (int i = 0; i < ny(S); i++) {
+
+		const FMIVariableType type = variableType(S, outputPortTypesParam, i);
+
+		void *y = ssGetOutputPortSignal(S, i);
+
+		const size_t nValues = outputPortWidth(S, i);
+		const FMIValueReference vr = valueReference(S, outputPortVariableVRsParam, i);
+
+		switch (type) {
+        case FMIFloat32Type:
+        case FMIDiscreteFloat32Type:
+            CHECK_STATUS(FMI3GetFloat32(instance, &vr, 1, (real32_T *)y, nValues));
+			break;
+        case FMIFloat64Type:
+        case FMIDiscreteFloat64Type:
+            CHECK_STATUS(FMI3GetFloat64(instance, &vr, 1, (real_T *)y, nValues));
+			break;
+		case FMIInt8Type:
+			CHECK_STATUS(FMI3GetInt8(instance, &vr, 1, (int8_T *)y, nValues));
+			break;
+		case FMIUInt8Type:
+			CHECK_STATUS(FMI3GetUInt8(instance, &vr, 1, (uint8_T *)y, nValues));
+			break;
+		case FMIInt16Type:
+			CHECK_STATUS(FMI3GetInt16(instance, &vr, 1, (int16_T *)y, nValues));
+			break;
+		case FMIUInt16Type:
+			CHECK_STATUS(FMI3GetUInt16(instance, &vr, 1, (uint16_T *)y, nValues));
+			break;
+		case FMIInt32Type:
+			CHECK_STATUS(FMI3GetInt32(instance, &vr, 1, (int32_T *)y, nValues));
+			break;
+		case FMIUInt32Type:
+			CHECK_STATUS(FMI3GetUInt32(instance, &vr, 1, (uint32_T *)y, nValues));
+			break;
+		case FMIInt64Type: {
+			fmi3Int64 *values = (fmi3Int64 *)plan->outputBuffers[i];
+			CHECK_STATUS(FMI3GetInt64(instance, &vr, 1, values, nValues));
+			int64ToInt32(values, (int32_T *)y, nValues);
+			break;
+		}
+		case FMIUInt64Type: {
+			fmi3UInt64 *values = (fmi3UInt64 *)plan->outputBuffers[i];
+			CHECK_STATUS(FMI3GetUInt64(instance, &vr, 1, values, nValues));
+			uint64ToUInt32(values, (uint32_T *)y, nValues);
+			break;
+		}
+		case FMIBooleanType: {
+			fmi3Boolean *values = (fmi3Boolean *)plan->outputBuffers[i];
+			CHECK_STATUS(FMI3GetBoolean(instance, &vr, 1, values, nValues));
+			fmi3BooleanToBoolean(values, (boolean_T *)y, nValues);
+			break;
+		}
+		default:
+			setErrorStatus(S, "Unsupported type id for FMI 3.0: %d", type);
+			return;
+		}
+	}
+}
+
+
+// time and continuous states last set on a model exchange FMU
+typedef struct {
+    bool valid;
+    time_T time;
+    real_T *x;
+} StateCache;
+
+static StateCache *createStateCache(SimStruct *S) {
+
+    StateCache *cache = calloc(1, sizeof(StateCache));
+
+    if (cache && nx(S) > 0) {
+        cache->x = calloc(nx(S), sizeof(real_T));
+    }
+
+    return cache;
+}
+
+static void freeStateCache(StateCache *cache) {
+
+    if (!cache) {
+        return;
+    }
+
+    free(cache->x);
+    free(cache);
+}
+
+// call when the FMU may have changed its states (events, initialization, reset)
+static void invalidateStateCache(SimStruct *S) {
 
     void **p = ssGetPWork(S);
 
-    FMIInstance *instance = (FMIInstance *)p[0];
-    FMIStatus status = FMIOK;
+    StateCache *cache = p ? (StateCache *)p[9] : NULL;
+
+    if (cache) {
+        cache->valid = false;
+    }
+}
+
+static bool timeChanged(SimStruct *S, time_T time) {
+
+    const StateCache *cache = (const StateCache *)ssGetPWork(S)[9];
+
+    return !cache || !cache->valid || cache->time != time;
+}
+
+// returns true if x differs from the states of the FMU
+static bool statesChanged(SimStruct *S, const real_T *x) {
+
+    const StateCache *cache = (const StateCache *)ssGetPWork(S)[9];
+
+    return !cache || !cache->valid || !cache->x || memcmp(cache->x, x, nx(S) * sizeof(real_T));
+}
+
+static void updateStateCache(SimStruct *S, time_T time, const real_T *x) {
+
+    StateCache *cache = (StateCache *)ssGetPWork(S)[9];
+
+    if (!cache) {
+        return;
+    }
+
+    cache->time = time;
+
+    if (cache->x) {
+        memcpy(cache->x, x, nx(S) * sizeof(real_T));
+    }
+
+    cache->valid = true;
+}
+
+
+// value references of the rows [derivatives, outputs] and columns [states, inputs, reset] of the Jacobian
+typedef struct {
+    size_t nRows;
+    size_t nColumns;
+    FMIValueReference *rowVRs;
+    FMIValueReference *columnVRs;
+    FMIJacobian *coloring;
+} Jacobian;
+
+static void freeJacobian(Jacobian *jacobian) {
+
+    if (!jacobian) {
+        return;
+    }
+
+    free(jacobian->rowVRs);
+    free(jacobian->columnVRs);
+    FMIFreeJacobian(jacobian->coloring);
+    free(jacobian);
+}
+
+static Jacobian *createJacobian(SimStruct *S) {
+
+    if (jacobianNzMax(S) == 0) {
+        return NULL;
+    }
+
+    Jacobian *jacobian = calloc(1, sizeof(Jacobian));
+
+    if (!jacobian) {
+        return NULL;
+    }
+
+    jacobian->nRows = nx(S) + nyv(S);
+    jacobian->nColumns = nx(S) + nuv(S) + (resettable(S) ? 1 : 0);
+
+    jacobian->rowVRs    = calloc(jacobian->nRows, sizeof(FMIValueReference));
+    jacobian->columnVRs = calloc(jacobian->nColumns, sizeof(FMIValueReference));
+
+    if (!jacobian->rowVRs || !jacobian->columnVRs) {
+        freeJacobian(jacobian);
+        return NULL;
+    }
+
+    for (int i = 0; i < nx(S); i++) {
+        jacobian->rowVRs[i] = valueReference(S, derivativeVRsParam, i);
+        jacobian->columnVRs[i] = valueReference(S, continuousStateVRsParam, i);
+    }
+
+    for (int i = 0; i < nyv(S); i++) {
+        jacobian->rowVRs[nx(S) + i] = valueReference(S, outputPortVariableVRsParam, i);
+    }
+
+    // the reset column has no entries
+    for (int i = 0; i < nuv(S); i++) {
+        jacobian->columnVRs[nx(S) + i] = valueReference(S, inputPortVariableVRsParam, i);
+    }
+
+    // the sparsity pattern is given by the parameters
+    const real_T *ir = (const real_T *)mxGetData(ssGetSFcnParam(S, jacobianIrParam));
+    const real_T *jc = (const real_T *)mxGetData(ssGetSFcnParam(S, jacobianJcParam));
+
+    int_T *Ir = ssGetJacobianIr(S);
+    int_T *Jc = ssGetJacobianJc(S);
+
+    size_t *rowIndices = calloc(jacobianNzMax(S), sizeof(size_t));
+    size_t *columnStarts = calloc(jacobian->nColumns + 1, sizeof(size_t));
+
+    if (rowIndices && columnStarts) {
+
+        for (int k = 0; k < jacobianNzMax(S); k++) {
+            rowIndices[k] = (size_t)ir[k];
+            if (Ir) Ir[k] = (int_T)ir[k];
+        }
+
+        for (size_t j = 0; j <= jacobian->nColumns; j++) {
+            columnStarts[j] = (size_t)jc[j];
+            if (Jc) Jc[j] = (int_T)jc[j];
+        }
+
+        // group the structurally orthogonal columns to reduce the number of directional derivatives
+        jacobian->coloring = FMICreateJacobian(jacobian->nRows, jacobian->nColumns, rowIndices, columnStarts);
+    }
+
+    free(rowIndices);
+    free(columnStarts);
+
+    if (!jacobian->coloring) {
+        freeJacobian(jacobian);
+        return NULL;
+    }
+
+    return jacobian;
+}
+
+static size_t parameterSize(SimStruct *S, FMIVariableType type) {
+
+    if (isFMI2(S)) {
+        switch (type) {
+        case FMIRealType:    return sizeof(fmi2Real);
+        case FMIIntegerType: return sizeof(fmi2Integer);
+        case FMIBooleanType: return sizeof(fmi2Boolean);
+        case FMIStringType:  return sizeof(fmi2String);
+        default:             return 0;
+        }
+    }
+
+    switch (type) {
+    case FMIFloat32Type: return sizeof(fmi3Float32);
+    case FMIFloat64Type: return sizeof(fmi3Float64);
+    case FMIInt8Type:    return sizeof(fmi3Int8);
+    case FMIUInt8Type:   return sizeof(fmi3UInt8);
+    case FMIInt16Type:   return sizeof(fmi3Int16);
+    case FMIUInt16Type:  return sizeof(fmi3UInt16);
+    case FMIInt32Type:   return sizeof(fmi3Int32);
+    case FMIUInt32Type:  return sizeof(fmi3UInt32);
+    case FMIInt64Type:   return sizeof(fmi3Int64);
+    case FMIUInt64Type:  return sizeof(fmi3UInt64);
+    case FMIBooleanType: return sizeof(fmi3Boolean);
+    case FMIStringType:  return sizeof(fmi3String);
+    default:             return 0;
+    }
+}
+
+// type of the set call (discrete variables are set like continuous ones)
+static FMIVariableType parameterType(FMIVariableType type) {
+    switch (type) {
+    case FMIDiscreteFloat32Type: return FMIFloat32Type;
+    case FMIDiscreteFloat64Type: return FMIFloat64Type;
+    default:                     return type;
+    }
+}
+
+// number of values of the parameter (FMI 3.0 parameters can be arrays)
+static size_t parameterLength(SimStruct *S, FMIVariableType type, const mxArray *pa) {
+    return isFMI3(S) && type != FMIStringType && mxIsDouble(pa) ? mxGetNumberOfElements(pa) : 1;
+}
+
+static void convertParameter(SimStruct *S, FMIVariableType type, const mxArray *pa, size_t nValues, void *values) {
+
+    const double *v = mxIsDouble(pa) ? mxGetPr(pa) : NULL;
+
+    for (size_t j = 0; j < nValues; j++) {
+
+        const double value = v ? v[j] : mxGetScalar(pa);
+
+        switch (type) {
+        case FMIFloat32Type: ((fmi3Float32 *)values)[j] = (fmi3Float32)value; break;
+        case FMIFloat64Type: ((fmi3Float64 *)values)[j] = (fmi3Float64)value; break;
+        case FMIInt8Type:    ((fmi3Int8    *)values)[j] = (fmi3Int8   )value; break;
+        case FMIUInt8Type:   ((fmi3UInt8   *)values)[j] = (fmi3UInt8  )value; break;
+        case FMIInt16Type:   ((fmi3Int16   *)values)[j] = (fmi3Int16  )value; break;
+        case FMIUInt16Type:  ((fmi3UInt16  *)values)[j] = (fmi3UInt16 )value; break;
+        case FMIInt32Type:   ((fmi3Int32   *)values)[j] = (fmi3Int32  )value; break;
+        case FMIUInt32Type:  ((fmi3UInt32  *)values)[j] = (fmi3UInt32 )value; break;
+        case FMIInt64Type:   ((fmi3Int64   *)values)[j] = (fmi3Int64  )value; break;
+        case FMIUInt64Type:  ((fmi3UInt64  *)values)[j] = (fmi3UInt64 )value; break;
+        case FMIBooleanType:
+            if (isFMI2(S)) {
+                ((fmi2Boolean *)values)[j] = (fmi2Boolean)value;
+            } else {
+                ((fmi3Boolean *)values)[j] = value != 0;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static FMIStatus setParameterGroup(FMIInstance *instance, FMIVariableType type, const ParameterGroup *group) {
+
+    const FMIValueReference *vr = group->valueReferences;
+    const size_t nvr = group->nValueReferences;
+    const size_t nValues = group->nValues;
+    const void *values = group->values;
+
+    if (instance->fmiVersion == FMIVersion2) {
+        switch (type) {
+        case FMIRealType:    return FMI2SetReal(instance, vr, nvr, (const fmi2Real *)values);
+        case FMIIntegerType: return FMI2SetInteger(instance, vr, nvr, (const fmi2Integer *)values);
+        case FMIBooleanType: return FMI2SetBoolean(instance, vr, nvr, (const fmi2Boolean *)values);
+        case FMIStringType:  return FMI2SetString(instance, vr, nvr, (const fmi2String *)values);
+        default:             return FMIError;
+        }
+    }
+
+    switch (type) {
+    case FMIFloat32Type: return FMI3SetFloat32(instance, vr, nvr, (const fmi3Float32 *)values, nValues);
+    case FMIFloat64Type: return FMI3SetFloat64(instance, vr, nvr, (const fmi3Float64 *)values, nValues);
+    case FMIInt8Type:    return FMI3SetInt8   (instance, vr, nvr, (const fmi3Int8    *)values, nValues);
+    case FMIUInt8Type:   return FMI3SetUInt8  (instance, vr, nvr, (const fmi3UInt8   *)values, nValues);
+    case FMIInt16Type:   return FMI3SetInt16  (instance, vr, nvr, (const fmi3Int16   *)values, nValues);
+    case FMIUInt16Type:  return FMI3SetUInt16 (instance, vr, nvr, (const fmi3UInt16  *)values, nValues);
+    case FMIInt32Type:   return FMI3SetInt32  (instance, vr, nvr, (const fmi3Int32   *)values, nValues);
+    case FMIUInt32Type:  return FMI3SetUInt32 (instance, vr, nvr, (const fmi3UInt32  *)values, nValues);
+    case FMIInt64Type:   return FMI3SetInt64  (instance, vr, nvr, (const fmi3Int64   *)values, nValues);
+    case FMIUInt64Type:  return FMI3SetUInt64 (instance, vr, nvr, (const fmi3UInt64  *)values, nValues);
+    case FMIBooleanType: return FMI3SetBoolean(instance, vr, nvr, (const fmi3Boolean *)values, nValues);
+    case FMIStringType:  return FMI3SetString (instance, vr, nvr, (const fmi3String  *)values, nValues);
+    default:             return FMIError;
+    }
+}
+
+// raw data of the parameters when they were last set
+typedef struct {
+    size_t nParameters;
+    size_t *sizes;
+    void **data;
+} ParameterSnapshot;
+
+static void freeParameterSnapshot(ParameterSnapshot *snapshot) {
+
+    if (!snapshot) {
+        return;
+    }
+
+    for (size_t i = 0; i < snapshot->nParameters; i++) {
+        free(snapshot->data[i]);
+    }
+
+    free(snapshot->sizes);
+    free(snapshot->data);
+    free(snapshot);
+}
+
+static ParameterSnapshot *parameterSnapshot(SimStruct *S) {
+
+    void **p = ssGetPWork(S);
+
+    if (!p[8]) {
+
+        ParameterSnapshot *snapshot = calloc(1, sizeof(ParameterSnapshot));
+
+        snapshot->nParameters = (ssGetSFcnParamsCount(S) - firstTunableParam(S)) / 5;
+        snapshot->sizes = calloc(snapshot->nParameters, sizeof(size_t));
+        snapshot->data = calloc(snapshot->nParameters, sizeof(void *));
+
+        p[8] = snapshot;
+    }
+
+    return (ParameterSnapshot *)p[8];
+}
+
+// returns true if the value of parameter i differs from the value that was last set
+static bool parameterChanged(SimStruct *S, int i) {
+
+    const ParameterSnapshot *snapshot = parameterSnapshot(S);
+    const size_t k = (i - firstTunableParam(S)) / 5;
+
+    const mxArray *pa = ssGetSFcnParam(S, i + 4);
+    const size_t size = mxGetElementSize(pa) * mxGetNumberOfElements(pa);
+
+    return !snapshot->data[k] || snapshot->sizes[k] != size || memcmp(snapshot->data[k], mxGetData(pa), size);
+}
+
+static void updateParameterSnapshot(SimStruct *S, int i) {
+
+    ParameterSnapshot *snapshot = parameterSnapshot(S);
+    const size_t k = (i - firstTunableParam(S)) / 5;
+
+    const mxArray *pa = ssGetSFcnParam(S, i + 4);
+    const size_t size = mxGetElementSize(pa) * mxGetNumberOfElements(pa);
+
+    if (snapshot->sizes[k] != size || !snapshot->data[k]) {
+        free(snapshot->data[k]);
+        snapshot->data[k] = malloc(size > 0 ? size : 1);
+        snapshot->sizes[k] = size;
+    }
+
+    memcpy(snapshot->data[k], mxGetData(pa), size);
+}
+
+// all, only structural, only tunable (only the ones that have changed)
+// collect the values of the parameters per type (groups must be zero-initialized) and return false if there are none
+static bool collectParameters(SimStruct *S, bool structuralOnly, bool tunableOnly, ParameterGroup groups[]) {
+
+    if (!isFMI2(S) && !isFMI3(S)) {
+        return false;
+    }
 
     int nSFcnParams = ssGetSFcnParamsCount(S);
 
-    for (int i = numParams; i < nSFcnParams; i += 5) {
+    // count the value references and values per type
+    for (int i = firstTunableParam(S); i < nSFcnParams; i += 5) {
+
+        const bool strucural = (bool)mxGetScalar(ssGetSFcnParam(S, i));
+        const bool tunable = (bool)mxGetScalar(ssGetSFcnParam(S, i + 1));
+        const FMIVariableType type = parameterType((FMIVariableType)mxGetScalar(ssGetSFcnParam(S, i + 2)));
+
+        if (structuralOnly && !strucural) continue;
+
+        if (tunableOnly && (!tunable || !parameterChanged(S, i))) continue;
+
+        if (parameterSize(S, type) == 0) {
+            setErrorStatus(S, "Unsupported type id for FMI %s: %d", isFMI2(S) ? "2.0" : "3.0", type);
+            return false;
+        }
+
+        groups[type].nValueReferences++;
+        groups[type].nValues += parameterLength(S, type, ssGetSFcnParam(S, i + 4));
+    }
+
+    bool empty = true;
+
+    for (int type = 0; type <= FMIStringType; type++) {
+
+        ParameterGroup *group = &groups[type];
+
+        if (group->nValueReferences == 0) continue;
+
+        group->valueReferences = calloc(group->nValueReferences, sizeof(FMIValueReference));
+        group->values = calloc(group->nValues, parameterSize(S, type));
+
+        group->nValueReferences = 0;
+        group->nValues = 0;
+
+        empty = false;
+    }
+
+    if (empty) {
+        return false;
+    }
+
+    // collect the values
+    for (int i = firstTunableParam(S); i < nSFcnParams; i += 5) {
 
         const bool strucural = (bool)mxGetScalar(ssGetSFcnParam(S, i));
         const bool tunable = (bool)mxGetScalar(ssGetSFcnParam(S, i + 1));
-        const FMIVariableType type = (FMIVariableType)mxGetScalar(ssGetSFcnParam(S, i + 2));
+        const FMIVariableType type = parameterType((FMIVariableType)mxGetScalar(ssGetSFcnParam(S, i + 2)));
         const FMIValueReference vr = (FMIValueReference)mxGetScalar(ssGetSFcnParam(S, i + 3));
 
         if (structuralOnly && !strucural) continue;
 
-        if (tunableOnly && !tunable) continue;
+        if (tunableOnly && (!tunable || !parameterChanged(S, i))) continue;
 
-        if (isFMI2(S)) {
+        updateParameterSnapshot(S, i);
 
-            if (instance->state == FMI2ContinuousTimeModeState) {
-                CHECK_STATUS(FMI2EnterEventMode(instance));
-            }
+        ParameterGroup *group = &groups[type];
 
-            // TODO: iterate over array
+        const mxArray *pa = ssGetSFcnParam(S, i + 4);
+        const size_t nValues = parameterLength(S, type, pa);
 
-            const mxArray *pa = ssGetSFcnParam(S, i + 4);
+        group->valueReferences[group->nValueReferences++] = vr;
 
-            switch (type) {
-            case FMIRealType:
-            case FMIDiscreteRealType: {
-                const fmi2Real value = (fmi2Real)mxGetScalar(pa);
-                CHECK_STATUS(FMI2SetReal(instance, &vr, 1, &value));
-                break;
-            }
-            case FMIIntegerType: {
-                const fmi2Integer value = (fmi2Integer)mxGetScalar(pa);
-                CHECK_STATUS(FMI2SetInteger(instance, &vr, 1, &value));
-                break;
-            }
-            case FMIBooleanType: {
-                const fmi2Boolean value = (fmi2Boolean)mxGetScalar(pa);
-                CHECK_STATUS(FMI2SetBoolean(instance, &vr, 1, &value));
-                break;
-            }
-            case FMIStringType: {
-                const fmi2String value = (fmi2String)getStringParam(S, i + 4, 0);
-               	CHECK_STATUS(FMI2SetString(instance, &vr, 1, (const fmi2String*)&value));
-                mxFree((void*)value);
-                break;
-            }
-            default:
-                setErrorStatus(S, "Unsupported type id for FMI 2.0: %d", type);
-                return;
+        if (type == FMIStringType) {
+            ((const char **)group->values)[group->nValues] = getStringParam(S, i + 4, 0);
+        } else {
+            convertParameter(S, type, pa, nValues, (char *)group->values + group->nValues * parameterSize(S, type));
+        }
+
+        group->nValues += nValues;
+    }
+
+    return true;
+}
+
+// set the parameters with one call per type and enter the event mode only once (does not access the SimStruct)
+static FMIStatus applyParameters(FMIInstance *instance, const ParameterGroup groups[]) {
+
+    FMIStatus status = FMIOK;
+
+    if (instance->fmiVersion == FMIVersion1) {
+        return FMIOK;
+    }
+
+    const bool fmi2 = instance->fmiVersion == FMIVersion2;
+
+    if (instance->state == FMI2ContinuousTimeModeState) {
+        status = fmi2 ? FMI2EnterEventMode(instance) : FMI3EnterEventMode(instance);
+    }
+
+    for (int type = 0; type <= FMIStringType && status <= FMIWarning; type++) {
+        if (groups[type].nValueReferences > 0) {
+            const FMIStatus s = setParameterGroup(instance, (FMIVariableType)type, &groups[type]);
+            status = s > status ? s : status;
+        }
+    }
+
+    if (status <= FMIWarning && instance->state == FMI2EventModeState) {
+        const FMIStatus s = fmi2 ? FMI2EnterContinuousTimeMode(instance) : FMI3EnterContinuousTimeMode(instance);
+        status = s > status ? s : status;
+    }
+
+    return status;
+}
+
+static void freeParameters(ParameterGroup groups[]) {
+
+    for (int type = 0; type <= FMIStringType; type++) {
+
+        ParameterGroup *group = &groups[type];
+
+        if (type == FMIStringType) {
+            for (size_t j = 0; j < group->nValues; j++) {
+                mxFree((void *)((const char **)group->values)[j]);
             }
+        }
+
+        free(group->valueReferences);
+        free(group->values);
+
+        memset(group, 0, sizeof(ParameterGroup));
+    }
+}
+
+static void setParameters(SimStruct *S, bool structuralOnly, bool tunableOnly) {
+
+    ParameterGroup groups[FMIStringType + 1];
+
+    memset(groups, 0, sizeof(groups));
+
+    if (!collectParameters(S, structuralOnly, tunableOnly, groups)) {
+        freeParameters(groups);
+        return;
+    }
 
-            if (instance->state == FMI2EventModeState) {
-                CHECK_STATUS(FMI2EnterContinuousTimeMode(instance));
-            }
-        
-		} else if (isFMI3(S)) {
+    invalidateStateCache(S);
 
-			if (instance->state == FMI2ContinuousTimeModeState) {
-				CHECK_STATUS(FMI3EnterEventMode(instance));
-			}
+    const FMIStatus status = applyParameters((FMIInstance *)ssGetPWork(S)[0], groups);
 
-			// TODO: iterate over array
+    freeParameters(groups);
 
-			const mxArray* pa = ssGetSFcnParam(S, i + 4);
+    CHECK_STATUS(status);
+}
 
-			switch (type) {
-			case FMIFloat32Type:
-			case FMIDiscreteFloat32Type: {
-				const fmi3Float32 value = (fmi3Float32)mxGetScalar(pa);
-				CHECK_STATUS(FMI3SetFloat32(instance, &vr, 1, &value, 1));
-				break;
-			}
-			case FMIFloat64Type:
-			case FMIDiscreteFloat64Type: {
-				const fmi3Float64 value = (fmi3Float64)mxGetScalar(pa);
-				CHECK_STATUS(FMI3SetFloat64(instance, &vr, 1, &value, 1));
-				break;
-			}
-			case FMIInt8Type: {
-				const fmi3Int8 value = (fmi3Int8)mxGetScalar(pa);
-				CHECK_STATUS(FMI3SetInt8(instance, &vr, 1, &value, 1));
-				break;
-			}
-			case FMIUInt8Type: {
-				const fmi3UInt8 value = (fmi3UInt8)mxGetScalar(pa);
-				CHECK_STATUS(FMI3SetUInt8(instance, &vr, 1, &value, 1));
-				break;
-			}
-			case FMIInt16Type: {
-				const fmi3Int16 value = (fmi3Int16)mxGetScalar(pa);
-				CHECK_STATUS(FMI3SetInt16(instance, &vr, 1, &value, 1));
-				break;
-			}
-			case FMIUInt16Type: {
-				const fmi3UInt16 value = (fmi3UInt16)mxGetScalar(pa);
-				CHECK_STATUS(FMI3SetUInt16(instance, &vr, 1, &value, 1));
-				break;
-			}
-			case FMIInt32Type: {
-				const fmi3Int32 value = (fmi3Int32)mxGetScalar(pa);
-				CHECK_STATUS(FMI3SetInt32(instance, &vr, 1, &value, 1));
-				break;
-			}
-			case FMIUInt32Type: {
-				const fmi3UInt32 value = (fmi3UInt32)mxGetScalar(pa);
-				CHECK_STATUS(FMI3SetUInt32(instance, &vr, 1, &value, 1));
-				break;
-			}
-			case FMIInt64Type: {
-				const fmi3Int64 value = (fmi3Int64)mxGetScalar(pa);
-				CHECK_STATUS(FMI3SetInt64(instance, &vr, 1, &value, 1));
-				break;
-			}
-			case FMIUInt64Type: {
-				const fmi3UInt64 value = (fmi3UInt64)mxGetScalar(pa);
-				CHECK_STATUS(FMI3SetUInt64(instance, &vr, 1, &value, 1));
-				break;
-			}
-			case FMIBooleanType: {
-				const fmi3Boolean value = (fmi3Boolean)mxGetScalar(pa);
-				CHECK_STATUS(FMI3SetBoolean(instance, &vr, 1, &value, 1));
-				break;
-			}
-			case FMIStringType: {
-				fmi3String value = (fmi3String)getStringParam(S, i + 4, 0);
-				CHECK_STATUS(FMI3SetString(instance, &vr, 1, (const fmi3String*)&value, 1));
-				mxFree((void*)value);
-				break;
-			}
-			default:
-				setErrorStatus(S, "Unsupported type id for FMI 3.0: %d", type);
-				return;
-			}
+/* compare the event indicators with the previous ones, set rootsFound (1: rising, -1: falling)
+   and remember the current ones in one branch-free pass the compiler can vectorize */
+static bool detectStateEvents(real_T *prez, const real_T *z, fmi3Int32 *rootsFound, size_t n) {
 
-			if (instance->state == FMI2EventModeState) {
-				CHECK_STATUS(FMI3EnterContinuousTimeMode(instance));
-			}
+    int events = 0;
 
-		}
+    for (size_t i = 0; i < n; i++) {
+
+        const real_T pre = prez[i];
+        const real_T cur = z[i];
+
+        const int rising  = ((pre < 0) & (cur >= 0)) | ((pre == 0) & (cur > 0));
+        const int falling = ((pre > 0) & (cur <= 0)) | ((pre == 0) & (cur < 0));
 
+        rootsFound[i] = rising - falling;
+        prez[i] = cur;
+
+        events |= rising | falling;
     }
 
+    return events != 0;
 }
 
-#define SET_VALUES(t) \
-	{ \
-		fmi3 ## t *values = calloc(s, sizeof(fmi3 ## t)); \
-		for (int j = 0; j < nValues; j++) { \
-			values[j] = (fmi3 ## t)realValues[iv + j]; \
-		} \
-		CHECK_STATUS(FMI3Set ## t(instance, &vr, 1, values, nValues)); \
-		free(values); \
-	}
-
 static void update(SimStruct *S, bool inputEvent) {
 
 	if (isCS(S)) {
@@ -1017,23 +2111,16 @@ static void update(SimStruct *S, bool inputEvent) {
 			CHECK_STATUS(FMI3GetEventIndicators(instance, z, nz(S)));
 		}
 
-		// check for state events
-		for (int i = 0; i < nz(S); i++) {
+		// check for state events and remember the current event indicators
+		stateEvent = detectStateEvents(prez, z, rootsFound, nz(S));
 
-			const bool rising  = (prez[i] < 0 && z[i] >= 0) || (prez[i] == 0 && z[i] > 0);
-			const bool falling = (prez[i] > 0 && z[i] <= 0) || (prez[i] == 0 && z[i] < 0);
-
-			if (rising || falling) {
-				logDebug(S, "State event %s z[%d] at t=%.16g", rising ? "-\\+" : "+/-", i, instance->time);
-				stateEvent = true;
-				rootsFound[i] = rising ? 1 : -1;
-			} else {
-				rootsFound[i] = 0;
+		if (stateEvent && logFMICalls(S)) {
+			for (int i = 0; i < nz(S); i++) {
+				if (rootsFound[i]) {
+					logDebug(S, "State event %s z[%d] at t=%.16g", rootsFound[i] > 0 ? "-\\+" : "+/-", i, instance->time);
+				}
 			}
 		}
-
-		// remember the current event indicators
-		for (int i = 0; i < nz(S); i++) prez[i] = z[i];
 	}
 
 	if (inputEvent || timeEvent || stepEvent || stateEvent) {
@@ -1058,180 +2145,560 @@ static void update(SimStruct *S, bool inputEvent) {
 				}
 			} while (instance->fmi2Functions->eventInfo.newDiscreteStatesNeeded);
 
-			CHECK_STATUS(FMI2EnterContinuousTimeMode(instance));
-		
-		} else {
+			CHECK_STATUS(FMI2EnterContinuousTimeMode(instance));
+		
+		} else {
+
+            CHECK_STATUS(FMI3EnterEventMode(instance));
+
+            CHECK_ERROR(setInput(S, true, true, &inputEvent));
+
+			do {
+				CHECK_STATUS(FMI3UpdateDiscreteStates(instance,
+					&instance->fmi3Functions->discreteStatesNeedUpdate,
+					&instance->fmi3Functions->terminateSimulation,
+					&instance->fmi3Functions->nominalsOfContinuousStatesChanged,
+					&instance->fmi3Functions->valuesOfContinuousStatesChanged,
+					&instance->fmi3Functions->nextEventTimeDefined,
+					&instance->fmi3Functions->nextEventTime));
+
+				if (instance->fmi3Functions->terminateSimulation) {
+					setErrorStatus(S, "The FMU requested to terminate the simulation.");
+					return;
+				}
+			} while (instance->fmi3Functions->discreteStatesNeedUpdate);
+
+			CHECK_STATUS(FMI3EnterContinuousTimeMode(instance));
+		}
+
+		if (nx(S) > 0) {
+
+			real_T *x = ssGetContStates(S);
+
+			if (isFMI1(S)) {
+				CHECK_STATUS(FMI1GetContinuousStates(instance, x, nx(S)));
+			} else if (isFMI2(S)) {
+				CHECK_STATUS(FMI2GetContinuousStates(instance, x, nx(S)));
+			} else {
+				CHECK_STATUS(FMI3GetContinuousStates(instance, x, nx(S)));
+			}
+		}
+
+		if (nz(S) > 0) {
+
+			real_T *prez = ssGetRWork(S);
+
+			if (isFMI1(S)) {
+				CHECK_STATUS(FMI1GetEventIndicators(instance, prez, nz(S)));
+			} else if (isFMI2(S)) {
+				CHECK_STATUS(FMI2GetEventIndicators(instance, prez, nz(S)));
+			} else {
+				CHECK_STATUS(FMI3GetEventIndicators(instance, prez, nz(S)));
+			}
+		}
+
+		invalidateStateCache(S);
+
+		ssSetSolverNeedsReset(S);
+	}
+}
+
+static bool isScalar(SimStruct *S, Parameter param) {
+	const mxArray *array = ssGetSFcnParam(S, param);
+	return mxIsNumeric(array) && mxGetNumberOfElements(array) == 1;
+}
+
+static bool isValidVariableType(FMIVariableType type) {
+	switch (type) {
+    case FMIFloat32Type:
+    case FMIDiscreteFloat32Type:
+    case FMIFloat64Type:
+    case FMIDiscreteFloat64Type:
+    case FMIInt8Type:
+	case FMIUInt8Type:
+	case FMIInt16Type:
+	case FMIUInt16Type:
+	case FMIInt32Type:
+	case FMIUInt32Type:
+	case FMIInt64Type:
+	case FMIUInt64Type:
+	case FMIBooleanType:
+	case FMIStringType:
+	// case FMIBinaryType:
+	// case FMIClockType:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// collect the arguments of the initialization from the SimStruct
+static void prepareInitialization(SimStruct *S, Initialization *initialization) {
+
+    initialization->time              = ssGetT(S);
+    initialization->stopTime          = ssGetTFinal(S);
+    initialization->relativeTolerance = relativeTolerance(S);
+
+    if (isFMI3(S) && mxGetNumberOfElements(ssGetSFcnParam(S, inputPortWidthsParam)) > 0) {
+        initialization->configure = true;
+        CHECK_ERROR(collectParameters(S, true, false, initialization->structuralParameters));
+    }
+
+    CHECK_ERROR(collectParameters(S, false, false, initialization->parameters));
+}
+
+static void freeInitialization(Initialization *initialization) {
+    freeParameters(initialization->structuralParameters);
+    freeParameters(initialization->parameters);
+}
+
+// set the parameters and initialize the FMU (runs on a worker thread with FMI_PARALLEL_INSTANTIATION and must not access the SimStruct)
+static FMIStatus initializeInstance(FMIInstance *instance, Initialization *initialization) {
+
+    FMIStatus status = FMIOK;
+
+    const time_T time = initialization->time;
+    const time_T stopTime = initialization->stopTime;
+    const double relativeTolerance = initialization->relativeTolerance;
+    const bool toleranceDefined = relativeTolerance > 0;
+    const bool cs = instance->interfaceType == FMICoSimulation;
+
+#define CHECK_INITIALIZATION(s) status = s; if (status > FMIWarning) return status;
+
+    if (instance->fmiVersion == FMIVersion1) {
+
+        if (cs) {
+            CHECK_INITIALIZATION(FMI1InitializeSlave(instance, time, stopTime > time, stopTime));
+        } else {
+            CHECK_INITIALIZATION(FMI1SetTime(instance, time));
+            CHECK_INITIALIZATION(FMI1Initialize(instance, toleranceDefined, relativeTolerance, &instance->fmi1Functions->eventInfo));
+            if (instance->fmi1Functions->eventInfo.terminateSimulation) {
+                initialization->errorMessage = "Model requested termination at init";
+                return FMIError;
+            }
+        }
+
+    } else if (instance->fmiVersion == FMIVersion2) {
+
+        CHECK_INITIALIZATION(applyParameters(instance, initialization->parameters));
+        CHECK_INITIALIZATION(FMI2SetupExperiment(instance, toleranceDefined, relativeTolerance, time, stopTime > time, stopTime));
+        CHECK_INITIALIZATION(FMI2EnterInitializationMode(instance));
+
+        if (!cs) {
+            CHECK_INITIALIZATION(FMI2ExitInitializationMode(instance));
+        }
+
+    } else {
+
+        if (initialization->configure) {
+            CHECK_INITIALIZATION(FMI3EnterConfigurationMode(instance));
+            CHECK_INITIALIZATION(applyParameters(instance, initialization->structuralParameters));
+            CHECK_INITIALIZATION(FMI3ExitConfigurationMode(instance));
+        }
+
+        CHECK_INITIALIZATION(applyParameters(instance, initialization->parameters));
+        CHECK_INITIALIZATION(FMI3EnterInitializationMode(instance, toleranceDefined, relativeTolerance, time, stopTime > time, stopTime));
+
+        if (!cs) {
+            CHECK_INITIALIZATION(FMI3ExitInitializationMode(instance));
+        }
+    }
+
+#undef CHECK_INITIALIZATION
+
+    return status;
+}
+
+// get the initial continuous states and event indicators of a Model Exchange FMU
+static void finishInitialization(SimStruct *S) {
+
+    if (!isME(S)) {
+        return;
+    }
+
+    FMIInstance *instance = (FMIInstance *)ssGetPWork(S)[0];
+
+    // initialize the continuous states
+    real_T *x = ssGetContStates(S);
+
+    if (nx(S) > 0) {
+
+        if (isFMI1(S)) {
+            CHECK_STATUS(FMI1GetContinuousStates(instance, x, nx(S)));
+        } else if (isFMI2(S)) {
+            CHECK_STATUS(FMI2GetContinuousStates(instance, x, nx(S)));
+        } else {
+            CHECK_STATUS(FMI3GetContinuousStates(instance, x, nx(S)));
+        }
+    }
+
+    // initialize the event indicators
+    if (nz(S) > 0) {
+
+        real_T *prez = ssGetRWork(S);
+
+        if (isFMI1(S)) {
+            CHECK_STATUS(FMI1GetEventIndicators(instance, prez, nz(S)));
+        } else if (isFMI2(S)) {
+            CHECK_STATUS(FMI2GetEventIndicators(instance, prez, nz(S)));
+        } else {
+            CHECK_STATUS(FMI3GetEventIndicators(instance, prez, nz(S)));
+        }
+
+        real_T *z = prez + nz(S);
+
+        memcpy(z, prez, nz(S) * sizeof(real_T));
+    }
+}
+
+static void initialize(SimStruct *S) {
+
+    invalidateStateCache(S);
+
+    Initialization initialization;
+
+    memset(&initialization, 0, sizeof(Initialization));
+
+    prepareInitialization(S, &initialization);
+
+    if (ssGetErrorStatus(S)) {
+        freeInitialization(&initialization);
+        return;
+    }
+
+    const FMIStatus status = initializeInstance((FMIInstance *)ssGetPWork(S)[0], &initialization);
+
+    freeInitialization(&initialization);
+
+    if (initialization.errorMessage) {
+        setErrorStatus(S, initialization.errorMessage);
+        return;
+    }
+
+    CHECK_STATUS(status);
+
+    CHECK_ERROR(finishInitialization(S));
+}
+
+// instantiate the FMU (runs on a worker thread with FMI_PARALLEL_INSTANTIATION and must not access the SimStruct)
+static FMIStatus instantiateInstance(Instantiation *instantiation) {
+
+    FMIInstance *instance = instantiation->instance;
+
+    const char *modelIdentifier     = instantiation->modelIdentifier;
+    const char *guid                = instantiation->guid;
+    const char *fmuResourceLocation = instantiation->fmuResourceLocation;
+    const bool loggingOn            = instantiation->loggingOn;
+    const bool cs                   = instantiation->interfaceType == FMICoSimulation;
+
+    switch (instantiation->fmiVersion) {
+    case FMIVersion1:
+        if (cs) {
+            return FMI1InstantiateSlave(instance, modelIdentifier, guid, fmuResourceLocation, "application/x-fmu-sharedlibrary", 0, fmi1False, fmi1False, loggingOn);
+        } else {
+            return FMI1InstantiateModel(instance, modelIdentifier, guid, loggingOn);
+        }
+    case FMIVersion2:
+        return FMI2Instantiate(instance, fmuResourceLocation, cs ? fmi2CoSimulation : fmi2ModelExchange, guid, fmi2False, loggingOn);
+    default:
+        if (cs) {
+            return FMI3InstantiateCoSimulation(instance, guid, fmuResourceLocation, fmi3False, loggingOn, fmi3False, fmi3False, NULL, 0, NULL);
+        } else {
+            return FMI3InstantiateModelExchange(instance, guid, fmuResourceLocation, fmi3False, loggingOn);
+        }
+    }
+}
+
+// instantiate and initialize the FMU (runs on a worker thread with FMI_PARALLEL_INSTANTIATION and must not access the SimStruct)
+static FMIStatus instantiate(Instantiation *instantiation) {
+
+    const FMIStatus status = instantiateInstance(instantiation);
+
+    if (status > FMIWarning) {
+        return status;
+    }
+
+    return initializeInstance(instantiation->instance, &instantiation->initialization);
+}
+
+static void freeInstantiation(Instantiation *instantiation) {
+
+    free(instantiation->modelIdentifier);
+    free(instantiation->guid);
+
+    freeInitialization(&instantiation->initialization);
+
+#ifdef FMI_PARALLEL_INSTANTIATION
+    free(instantiation->messages.messages);
+#endif
+
+    free(instantiation);
+}
+
+#ifdef FMI_PARALLEL_INSTANTIATION
+THREAD_FUNCTION(instantiateAsync) {
+
+    Instantiation *instantiation = (Instantiation *)arg;
+
+    instantiation->status = instantiate(instantiation);
+
+    THREAD_RETURN;
+}
+#endif
+
+// wait for the worker thread and write the messages it has logged
+static FMIStatus joinInstantiation(SimStruct *S) {
+
+    FMIStatus status = FMIOK;
+
+#ifdef FMI_PARALLEL_INSTANTIATION
+    void **p = ssGetPWork(S);
+
+    Instantiation *instantiation = p ? (Instantiation *)p[6] : NULL;
+
+    if (!instantiation) {
+        return FMIOK;
+    }
+
+    joinThread(instantiation->thread);
+
+    p[6] = NULL;
+
+    restoreLogging(S, instantiation->instance);
+
+    writeDeferredMessages(S, &instantiation->messages);
+
+    status = instantiation->status;
+
+    if (instantiation->initialization.errorMessage) {
+        setErrorStatus(S, instantiation->initialization.errorMessage);
+    }
+
+    destroyMutex(&instantiation->messages.mutex);
+
+    freeInstantiation(instantiation);
+#endif
+
+    return status;
+}
+
+// compute a co-simulation step (runs on a worker thread with FMI_PIPELINED_CO_SIMULATION and must not access the SimStruct,
+// startStep() redirects the log callbacks to the message buffer of the pipeline)
+static FMIStatus doStep(FMIInstance *instance, double currentCommunicationPoint, double communicationStepSize) {
+
+    switch (instance->fmiVersion) {
+    case FMIVersion1:
+        return FMI1DoStep(instance, currentCommunicationPoint, communicationStepSize, fmi1True);
+    case FMIVersion2:
+        return FMI2DoStep(instance, currentCommunicationPoint, communicationStepSize, fmi2True);
+    default: {
+        fmi3Boolean eventEncountered;
+        fmi3Boolean terminateSimulation;
+        fmi3Boolean earlyReturn;
+        fmi3Float64 lastSuccessfulTime;
+        // TODO: handle terminateSimulation == true
+        return FMI3DoStep(instance, currentCommunicationPoint, communicationStepSize, fmi3True, &eventEncountered, &terminateSimulation, &earlyReturn, &lastSuccessfulTime);
+    }
+    }
+}
+
+#ifdef FMI_PIPELINED_CO_SIMULATION
+THREAD_FUNCTION(pipelineThread) {
+
+    Pipeline *pipeline = (Pipeline *)arg;
+
+    lockMutex(&pipeline->mutex);
+
+    for (;;) {
+
+        while (!pipeline->busy && !pipeline->quit) {
+            waitCondition(&pipeline->condition, &pipeline->mutex);
+        }
+
+        if (pipeline->quit) {
+            break;
+        }
+
+        unlockMutex(&pipeline->mutex);
+
+        const FMIStatus status = doStep(pipeline->instance, pipeline->currentCommunicationPoint, pipeline->communicationStepSize);
 
-            CHECK_STATUS(FMI3EnterEventMode(instance));
+        lockMutex(&pipeline->mutex);
 
-            CHECK_ERROR(setInput(S, true, true, &inputEvent));
+        pipeline->status = status;
+        pipeline->busy = false;
 
-			do {
-				CHECK_STATUS(FMI3UpdateDiscreteStates(instance,
-					&instance->fmi3Functions->discreteStatesNeedUpdate,
-					&instance->fmi3Functions->terminateSimulation,
-					&instance->fmi3Functions->nominalsOfContinuousStatesChanged,
-					&instance->fmi3Functions->valuesOfContinuousStatesChanged,
-					&instance->fmi3Functions->nextEventTimeDefined,
-					&instance->fmi3Functions->nextEventTime));
+        signalCondition(&pipeline->condition);
+    }
 
-				if (instance->fmi3Functions->terminateSimulation) {
-					setErrorStatus(S, "The FMU requested to terminate the simulation.");
-					return;
-				}
-			} while (instance->fmi3Functions->discreteStatesNeedUpdate);
+    unlockMutex(&pipeline->mutex);
 
-			CHECK_STATUS(FMI3EnterContinuousTimeMode(instance));
-		}
+    THREAD_RETURN;
+}
 
-		if (nx(S) > 0) {
+static Pipeline *createPipeline(FMIInstance *instance) {
 
-			real_T *x = ssGetContStates(S);
+    Pipeline *pipeline = (Pipeline *)calloc(1, sizeof(Pipeline));
 
-			if (isFMI1(S)) {
-				CHECK_STATUS(FMI1GetContinuousStates(instance, x, nx(S)));
-			} else if (isFMI2(S)) {
-				CHECK_STATUS(FMI2GetContinuousStates(instance, x, nx(S)));
-			} else {
-				CHECK_STATUS(FMI3GetContinuousStates(instance, x, nx(S)));
-			}
-		}
+    if (!pipeline) {
+        return NULL;
+    }
 
-		if (nz(S) > 0) {
+    pipeline->instance = instance;
 
-			real_T *prez = ssGetRWork(S);
+    initMutex(&pipeline->mutex);
+    initMutex(&pipeline->messages.mutex);
+    initCondition(&pipeline->condition);
 
-			if (isFMI1(S)) {
-				CHECK_STATUS(FMI1GetEventIndicators(instance, prez, nz(S)));
-			} else if (isFMI2(S)) {
-				CHECK_STATUS(FMI2GetEventIndicators(instance, prez, nz(S)));
-			} else {
-				CHECK_STATUS(FMI3GetEventIndicators(instance, prez, nz(S)));
-			}
-		}
+    if (!startThread(&pipeline->thread, pipelineThread, pipeline)) {
+        destroyCondition(&pipeline->condition);
+        destroyMutex(&pipeline->messages.mutex);
+        destroyMutex(&pipeline->mutex);
+        free(pipeline);
+        return NULL;
+    }
 
-		ssSetSolverNeedsReset(S);
-	}
+    return pipeline;
 }
 
-static bool isScalar(SimStruct *S, Parameter param) {
-	const mxArray *array = ssGetSFcnParam(S, param);
-	return mxIsNumeric(array) && mxGetNumberOfElements(array) == 1;
-}
+static void freePipeline(Pipeline *pipeline) {
 
-static bool isValidVariableType(FMIVariableType type) {
-	switch (type) {
-    case FMIFloat32Type:
-    case FMIDiscreteFloat32Type:
-    case FMIFloat64Type:
-    case FMIDiscreteFloat64Type:
-    case FMIInt8Type:
-	case FMIUInt8Type:
-	case FMIInt16Type:
-	case FMIUInt16Type:
-	case FMIInt32Type:
-	case FMIUInt32Type:
-	case FMIInt64Type:
-	case FMIUInt64Type:
-	case FMIBooleanType:
-	case FMIStringType:
-	// case FMIBinaryType:
-	// case FMIClockType:
-		return true;
-	default:
-		return false;
-	}
+    if (!pipeline) {
+        return;
+    }
+
+    lockMutex(&pipeline->mutex);
+    pipeline->quit = true;
+    signalCondition(&pipeline->condition);
+    unlockMutex(&pipeline->mutex);
+
+    joinThread(pipeline->thread);
+
+    destroyCondition(&pipeline->condition);
+    destroyMutex(&pipeline->messages.mutex);
+    destroyMutex(&pipeline->mutex);
+
+    free(pipeline->messages.messages);
+    free(pipeline);
 }
+#endif
 
-static void initialize(SimStruct *S) {
+// start the co-simulation step to the next sample hit on the worker thread
+static void startStep(SimStruct *S) {
 
+#ifdef FMI_PIPELINED_CO_SIMULATION
     void **p = ssGetPWork(S);
 
-    FMIInstance *instance = p[0];
-    const time_T time = ssGetT(S);
+    FMIInstance *instance = (FMIInstance *)p[0];
+
+    const time_T nextTime = ssGetT(S) + sampleTime(S);
     const time_T stopTime = ssGetTFinal(S);  // can be -1
-    const bool toleranceDefined = relativeTolerance(S) > 0;
 
-    if (isFMI1(S)) {
+    // the next sample hit is unknown or after the end of the simulation
+    if (!isCS(S) || sampleTime(S) <= 0 || (stopTime > 0 && nextTime > stopTime)) {
+        return;
+    }
 
-        CHECK_ERROR(setParameters(S, false, false));
+    if (!p[7]) {
+        p[7] = createPipeline(instance);
+    }
 
-        if (isCS(S)) {
-            CHECK_STATUS(FMI1InitializeSlave(instance, time, stopTime > time, stopTime));
-        } else {
-            CHECK_STATUS(FMI1SetTime(instance, time));
-            CHECK_STATUS(FMI1Initialize(instance, toleranceDefined, relativeTolerance(S), &instance->fmi1Functions->eventInfo));
-            if (instance->fmi1Functions->eventInfo.terminateSimulation) {
-                setErrorStatus(S, "Model requested termination at init");
-                return;
-            }
+    Pipeline *pipeline = (Pipeline *)p[7];
+
+    if (!pipeline) {
+        return;  // compute the step in mdlOutputs()
+    }
+
+    if (!initialized(S)) {
+        if (isFMI2(S)) {
+            CHECK_STATUS(FMI2ExitInitializationMode(instance));
+        } else if (isFMI3(S)) {
+            CHECK_STATUS(FMI3ExitInitializationMode(instance));
         }
+    }
 
-    } else if (isFMI2(S)) {
+    redirectLogging(S, instance, &pipeline->messages);
 
-        CHECK_ERROR(setParameters(S, false, false));
-        CHECK_STATUS(FMI2SetupExperiment(instance, toleranceDefined, relativeTolerance(S), time, stopTime > time, stopTime));
-        CHECK_STATUS(FMI2EnterInitializationMode(instance));
+    lockMutex(&pipeline->mutex);
 
-    } else {
+    pipeline->currentCommunicationPoint = instance->time;
+    pipeline->communicationStepSize     = nextTime - instance->time;
+    pipeline->busy                      = true;
 
-        if (mxGetNumberOfElements(ssGetSFcnParam(S, inputPortWidthsParam)) > 0) {
-            CHECK_STATUS(FMI3EnterConfigurationMode(instance));
-            CHECK_ERROR(setParameters(S, true, false));
-            CHECK_STATUS(FMI3ExitConfigurationMode(instance));
-        }
+    signalCondition(&pipeline->condition);
+
+    unlockMutex(&pipeline->mutex);
+#endif
+}
+
+// wait for the co-simulation step on the worker thread
+static void awaitStep(SimStruct *S) {
 
-        CHECK_ERROR(setParameters(S, false, false));
+#ifdef FMI_PIPELINED_CO_SIMULATION
+    void **p = ssGetPWork(S);
 
-        CHECK_STATUS(FMI3EnterInitializationMode(instance, toleranceDefined, relativeTolerance(S), time, stopTime > time, stopTime));
+    Pipeline *pipeline = p ? (Pipeline *)p[7] : NULL;
 
+    if (!pipeline) {
+        return;
     }
 
-    if (isME(S)) {
+    lockMutex(&pipeline->mutex);
 
-		if (isFMI2(S)) {
-			CHECK_STATUS(FMI2ExitInitializationMode(instance));
-		} else {
-			CHECK_STATUS(FMI3ExitInitializationMode(instance));
-		}
+    while (pipeline->busy) {
+        waitCondition(&pipeline->condition, &pipeline->mutex);
+    }
 
-        // initialize the continuous states
-        real_T *x = ssGetContStates(S);
+    const FMIStatus status = pipeline->status;
 
-        if (nx(S) > 0) {
+    pipeline->status = FMIOK;
 
-            if (isFMI1(S)) {
-                CHECK_STATUS(FMI1GetContinuousStates(instance, x, nx(S)));
-            } else if (isFMI2(S)) {
-                CHECK_STATUS(FMI2GetContinuousStates(instance, x, nx(S)));
-            } else {
-                CHECK_STATUS(FMI3GetContinuousStates(instance, x, nx(S)));
-            }
-        }
+    unlockMutex(&pipeline->mutex);
 
-        // initialize the event indicators
-        if (nz(S) > 0) {
+    FMIInstance *instance = pipeline->instance;
 
-            real_T *prez = ssGetRWork(S);
+    restoreLogging(S, instance);
 
-            if (isFMI1(S)) {
-                CHECK_STATUS(FMI1GetEventIndicators(instance, prez, nz(S)));
-            } else if (isFMI2(S)) {
-                CHECK_STATUS(FMI2GetEventIndicators(instance, prez, nz(S)));
-            } else {
-                CHECK_STATUS(FMI3GetEventIndicators(instance, prez, nz(S)));
-            }
+    writeDeferredMessages(S, &pipeline->messages);
 
-            real_T *z = prez + nz(S);
+    // ignore the round-off between the predicted and the actual sample hit
+    if (fabs(ssGetT(S) - instance->time) <= 1e-10 * sampleTime(S)) {
+        instance->time = ssGetT(S);
+    }
 
-            memcpy(z, prez, nz(S) * sizeof(real_T));
-        }
+    CHECK_STATUS(status);
+#endif
+}
+
+// barrier before the first use of an FMU that is instantiated on a worker thread
+static void awaitInstantiation(SimStruct *S) {
+
+#ifdef FMI_PARALLEL_INSTANTIATION
+    void **p = ssGetPWork(S);
+
+    if (!p || !p[6]) {
+        return;
+    }
+
+    const FMIStatus status = joinInstantiation(S);
+
+    if (ssGetErrorStatus(S)) {
+        return;
     }
+
+    CHECK_STATUS(status);
+
+    CHECK_ERROR(finishInitialization(S));
+#endif
 }
 
 #define MDL_ENABLE
 static void mdlEnable(SimStruct *S) {
-    
+
+    CHECK_ERROR(awaitInstantiation(S));
+
+    CHECK_ERROR(awaitStep(S));
+
     logDebug(S, "mdlEnable()");
 
     void **p = ssGetPWork(S);
@@ -1319,9 +2786,23 @@ static void mdlEnable(SimStruct *S) {
 
     p[0] = instance;
 
+    if (traceFMICalls(S) && FMIStartTrace(instance, FMI_TRACE_BUFFER_SIZE) != FMIOK) {
+        ssSetErrorStatus(S, "Failed to allocate the trace buffer.");
+        return;
+    }
+
     const char *guid = getStringParam(S, guidParam, 0);
 
-    char fmuResourceLocation[INTERNET_MAX_URL_LENGTH];
+    Instantiation *instantiation = (Instantiation *)calloc(1, sizeof(Instantiation));
+
+    instantiation->instance        = instance;
+    instantiation->fmiVersion      = isFMI1(S) ? FMIVersion1 : isFMI2(S) ? FMIVersion2 : FMIVersion3;
+    instantiation->interfaceType   = isCS(S) ? FMICoSimulation : FMIModelExchange;
+    instantiation->loggingOn       = loggingOn;
+    instantiation->modelIdentifier = strdup(modelIdentifier);
+    instantiation->guid            = strdup(guid);
+
+    char *fmuResourceLocation = instantiation->fmuResourceLocation;
 
     if (isFMI3(S)) {
         strncpy(fmuResourceLocation, unzipdir, INTERNET_MAX_URL_LENGTH);
@@ -1329,6 +2810,7 @@ static void mdlEnable(SimStruct *S) {
 #ifdef _WIN32
         DWORD fmuLocationLength = INTERNET_MAX_URL_LENGTH;
         if (UrlCreateFromPath(unzipdir, fmuResourceLocation, &fmuLocationLength, 0) != S_OK) {
+            freeInstantiation(instantiation);
             setErrorStatus(S, "Failed to create fmuResourceLocation.");
             return;
         }
@@ -1341,37 +2823,57 @@ static void mdlEnable(SimStruct *S) {
     if (!isFMI1(S)) {
         strcat(fmuResourceLocation, "/resources");
     }
-    
-    // instantiate the FMU
-    if (isFMI1(S)) {
 
-        if (isCS(S)) {
-            CHECK_STATUS(FMI1InstantiateSlave(instance, modelIdentifier, guid, fmuResourceLocation, "application/x-fmu-sharedlibrary", 0, fmi1False, fmi1False, loggingOn));
-        } else {
-            CHECK_STATUS(FMI1InstantiateModel(instance, modelIdentifier, guid, loggingOn));
-        }
+    // free string parameters
+    mxFree((void *)modelIdentifier);
+    mxFree((void *)unzipdir);
+    mxFree((void *)guid);
 
-    } else if (isFMI2(S)) {
+    // collect the parameters and the experiment from the SimStruct on the simulation thread
+    invalidateStateCache(S);
 
-        CHECK_STATUS(FMI2Instantiate(instance, fmuResourceLocation, isCS(S) ? fmi2CoSimulation : fmi2ModelExchange, guid, fmi2False, loggingOn));
+    prepareInitialization(S, &instantiation->initialization);
 
-    } else {
+    if (ssGetErrorStatus(S)) {
+        freeInstantiation(instantiation);
+        return;
+    }
 
-        if (isME(S)) {
-            CHECK_STATUS(FMI3InstantiateModelExchange(instance, guid, fmuResourceLocation, fmi3False, loggingOn));
-        } else {
-            CHECK_STATUS(FMI3InstantiateCoSimulation(instance, guid, fmuResourceLocation, fmi3False, loggingOn, fmi3False, fmi3False, NULL, 0, NULL));
-        }
+#ifdef FMI_PARALLEL_INSTANTIATION
+    initMutex(&instantiation->messages.mutex);
+
+    redirectLogging(S, instance, &instantiation->messages);
 
+    p[6] = instantiation;
+
+    // instantiate and initialize the FMU on a worker thread and get the initial states in awaitInstantiation()
+    if (startThread(&instantiation->thread, instantiateAsync, instantiation)) {
+        return;
     }
 
-    // initialize the FMU instance
-    CHECK_ERROR(initialize(S));
+    p[6] = NULL;
 
-    // free string parameters
-    mxFree((void *)modelIdentifier);
-    mxFree((void *)unzipdir);
-    mxFree((void *)guid);
+    restoreLogging(S, instance);
+
+    destroyMutex(&instantiation->messages.mutex);
+#endif
+
+    const FMIStatus status = instantiate(instantiation);
+
+    // the error messages are string literals
+    const char *errorMessage = instantiation->initialization.errorMessage;
+
+    freeInstantiation(instantiation);
+
+    if (errorMessage) {
+        setErrorStatus(S, errorMessage);
+        return;
+    }
+
+    CHECK_STATUS(status);
+
+    // get the initial continuous states and event indicators
+    CHECK_ERROR(finishInitialization(S));
 }
 
 #define MDL_DISABLE
@@ -1574,6 +3076,37 @@ static void mdlCheckParameters(SimStruct *S) {
 
 	// TODO: check VRS values!
 
+	if (!hasJacobianParams(S)) {
+		return;  // block without an analytic Jacobian
+	}
+
+	for (int i = continuousStateVRsParam; i <= jacobianJcParam; i++) {
+		if (!mxIsDouble(ssGetSFcnParam(S, i))) {
+			setErrorStatus(S, "Parameter %d must be a double array", i + 1);
+			return;
+		}
+	}
+
+	if (mxGetNumberOfElements(ssGetSFcnParam(S, jacobianJcParam)) > 0) {
+
+		const size_t nColumns = nx(S) + nuv(S) + (resettable(S) ? 1 : 0);
+
+		if (mxGetNumberOfElements(ssGetSFcnParam(S, continuousStateVRsParam)) != nx(S) || mxGetNumberOfElements(ssGetSFcnParam(S, derivativeVRsParam)) != nx(S)) {
+			setErrorStatus(S, "The number of elements in parameters %d and %d (continuous state and derivative value references) must be equal to the number of continuous states", continuousStateVRsParam + 1, derivativeVRsParam + 1);
+			return;
+		}
+
+		if (mxGetNumberOfElements(ssGetSFcnParam(S, jacobianJcParam)) != nColumns + 1) {
+			setErrorStatus(S, "The number of elements in parameter %d (Jacobian column indices) must be equal to the number of states and inputs + 1", jacobianJcParam + 1);
+			return;
+		}
+
+		if (mxGetNumberOfElements(ssGetSFcnParam(S, jacobianIrParam)) != (size_t)jacobianNzMax(S)) {
+			setErrorStatus(S, "The number of elements in parameter %d (Jacobian row indices) must be equal to the number of non-zero elements", jacobianIrParam + 1);
+			return;
+		}
+	}
+
 }
 #endif /* MDL_CHECK_PARAMETERS */
 
@@ -1598,6 +3131,12 @@ static void mdlProcessParameters(SimStruct *S) {
 
     logDebug(S, "mdlProcessParameters()");
 
+    CHECK_ERROR(awaitInstantiation(S));
+
+    CHECK_ERROR(awaitStep(S));
+
+    updateBlockConfig(S);
+
     CHECK_ERROR(setParameters(S, false, true));
 }
 #endif /* MDL_PROCESS_PARAMETERS */
@@ -1609,18 +3148,19 @@ static void mdlInitializeSizes(SimStruct *S) {
 
     const int nSFcnParams = ssGetSFcnParamsCount(S);
 
-    if ((nSFcnParams - numParams) % 5) {
+    // blocks without the Jacobian parameters have 4 parameters less
+    if ((nSFcnParams - numParams) % 5 && (nSFcnParams - continuousStateVRsParam) % 5) {
         setErrorStatus(S, "Wrong number of arguments.");
         return;
     }
 
 	ssSetNumSFcnParams(S, nSFcnParams);
 
-    for (int i = 0; i < numParams; i++) {
+    for (int i = 0; i < firstTunableParam(S); i++) {
         ssSetSFcnParamTunable(S, i, false);
     }
 
-    for (int i = numParams; i < nSFcnParams; i += 5) {
+    for (int i = firstTunableParam(S); i < nSFcnParams; i += 5) {
         const double paramTunable = mxGetScalar(ssGetSFcnParam(S, i + 1));
         ssSetSFcnParamTunable(S, i, paramTunable != 0);
     }
@@ -1678,10 +3218,15 @@ static void mdlInitializeSizes(SimStruct *S) {
 
 	ssSetNumSampleTimes(S, 1);
 	ssSetNumRWork(S, 2 * nz(S) + nuv(S) + (resettable(S) ? 1 : 0)); // [pre(z), z, pre(u), pre(reset)]
-    ssSetNumPWork(S, 4); // [FMU, logfile, rootsFound, preInput]
+    ssSetNumPWork(S, 11); // [FMU, logfile, rootsFound, preInput, IOPlan, BlockConfig, Instantiation, Pipeline, ParameterSnapshot, StateCache, Jacobian]
     ssSetNumModes(S, 3); // [stateEvent, timeEvent, stepEvent]
 	ssSetNumNonsampledZCs(S, (isME(S)) ? nz(S) + 1 : 0);
 
+	// analytic Jacobian from directional derivatives
+	if (jacobianNzMax(S) > 0) {
+		ssSetJacobianNzMax(S, jacobianNzMax(S));
+	}
+
 	// specify the sim state compliance to be same as a built-in block
 	//ssSetSimStateCompliance(S, USE_DEFAULT_SIM_STATE);
 
@@ -1704,6 +3249,8 @@ static void mdlStart(SimStruct *S) {
 
     void **p = ssGetPWork(S);
 
+    updateBlockConfig(S);
+
     if (p[1]) {
         fclose((FILE *)p[1]);
         p[1] = NULL;
@@ -1729,6 +3276,22 @@ static void mdlStart(SimStruct *S) {
         memset(p[3], 0xFF, s);
     }
 
+    freeIOPlan((IOPlan *)p[4]);
+
+    p[4] = createIOPlan(S);
+
+    freeStateCache((StateCache *)p[9]);
+
+    p[9] = isME(S) ? createStateCache(S) : NULL;
+
+    freeJacobian((Jacobian *)p[10]);
+
+    p[10] = createJacobian(S);
+
+    if (p[10]) {
+        logDebug(S, "The Jacobian with %d non-zero elements is computed with %zu directional derivatives.", jacobianNzMax(S), ((Jacobian *)p[10])->coloring->nColors);
+    }
+
 	logDebug(S, "mdlStart()");
 }
 #endif /* MDL_START */
@@ -1736,6 +3299,10 @@ static void mdlStart(SimStruct *S) {
 
 static void mdlOutputs(SimStruct *S, int_T tid) {
 
+    CHECK_ERROR(awaitInstantiation(S));
+
+    CHECK_ERROR(awaitStep(S));
+
     const time_T time = ssGetT(S);
 
 	logDebug(S, "mdlOutputs(tid=%d, time=%.16g, majorTimeStep=%d)", tid, time, ssIsMajorTimeStep(S));
@@ -1770,9 +3337,11 @@ static void mdlOutputs(SimStruct *S, int_T tid) {
 
 		if (isFMI1(S)) {
 
-			CHECK_STATUS(FMI1SetTime(instance, time));
+			if (timeChanged(S, time)) {
+				CHECK_STATUS(FMI1SetTime(instance, time));
+			}
 
-			if (nx(S) > 0) {
+			if (nx(S) > 0 && statesChanged(S, x)) {
 				CHECK_STATUS(FMI1SetContinuousStates(instance, x, nx(S)));
 			}
 
@@ -1793,15 +3362,20 @@ static void mdlOutputs(SimStruct *S, int_T tid) {
 				} while (instance->fmi2Functions->eventInfo.newDiscreteStatesNeeded);
 
 				CHECK_STATUS(FMI2EnterContinuousTimeMode(instance));
+
+				invalidateStateCache(S);
 			}
 
 			if (instance->state != FMI2ContinuousTimeModeState) {
 				CHECK_STATUS(FMI2EnterContinuousTimeMode(instance));
+				invalidateStateCache(S);
 			}
 
-			CHECK_STATUS(FMI2SetTime(instance, time));
+			if (timeChanged(S, time)) {
+				CHECK_STATUS(FMI2SetTime(instance, time));
+			}
 
-			if (nx(S) > 0) {
+			if (nx(S) > 0 && statesChanged(S, x)) {
 				CHECK_STATUS(FMI2SetContinuousStates(instance, x, nx(S)));
 			}
 
@@ -1829,19 +3403,26 @@ static void mdlOutputs(SimStruct *S, int_T tid) {
 				} while (instance->fmi3Functions->discreteStatesNeedUpdate);
 
 				CHECK_STATUS(FMI3EnterContinuousTimeMode(instance));
+
+				invalidateStateCache(S);
 			}
 
 			if (instance->state != FMI2ContinuousTimeModeState) {
 				CHECK_STATUS(FMI3EnterContinuousTimeMode(instance));
+				invalidateStateCache(S);
 			}
 
-			CHECK_STATUS(FMI3SetTime(instance, time));
+			if (timeChanged(S, time)) {
+				CHECK_STATUS(FMI3SetTime(instance, time));
+			}
 
-			if (nx(S) > 0) {
+			if (nx(S) > 0 && statesChanged(S, x)) {
 				CHECK_STATUS(FMI3SetContinuousStates(instance, x, nx(S)));
 			}
 		}
 
+		updateStateCache(S, time, x);
+
         bool inputEvent;
 			   		
 		CHECK_ERROR(setInput(S, true, false, &inputEvent));
@@ -1864,18 +3445,7 @@ static void mdlOutputs(SimStruct *S, int_T tid) {
 				}
 			}
 
-			if (isFMI1(S)) {
-				CHECK_STATUS(FMI1DoStep(instance, instance->time, h, fmi1True));
-			} else if (isFMI2(S)) {
-				CHECK_STATUS(FMI2DoStep(instance, instance->time, h, fmi2True));
-			} else {
-				fmi3Boolean eventEncountered;
-				fmi3Boolean terminateSimulation;
-				fmi3Boolean earlyReturn;
-				fmi3Float64 lastSuccessfulTime;
-				CHECK_STATUS(FMI3DoStep(instance, instance->time, h, fmi3True, &eventEncountered, &terminateSimulation, &earlyReturn, &lastSuccessfulTime));
-                // TODO: handle terminateSimulation == true
-			}
+			CHECK_STATUS(doStep(instance, instance->time, h));
 		}
 	}
 
@@ -1893,6 +3463,8 @@ static void mdlUpdate(SimStruct *S, int_T tid) {
 
 	logDebug(S, "mdlUpdate(tid=%d, time=%.16g, majorTimeStep=%d)", tid, ssGetT(S), ssIsMajorTimeStep(S));
 
+    CHECK_ERROR(awaitStep(S));
+
     bool inputEvent;
 
     CHECK_ERROR(setInput(S, false, isCS(S), &inputEvent));
@@ -1900,6 +3472,8 @@ static void mdlUpdate(SimStruct *S, int_T tid) {
     if (isME(S) && inputEvent) {
         ssSetErrorStatus(S, "Unexpected input event in mdlUpdate().");
     }
+
+    CHECK_ERROR(startStep(S));
 }
 #endif // MDL_UPDATE
 
@@ -1977,26 +3551,86 @@ static void mdlDerivatives(SimStruct *S) {
 	real_T *x = ssGetContStates(S);
 	real_T *dx = ssGetdX(S);
 
+	// the FMU's states are already equal to x
+	const bool readStates = statesChanged(S, x);
+
 	if (isFMI1(S)) {
-        CHECK_STATUS(FMI1GetContinuousStates(instance, x, nx(S)));
+        if (readStates) {
+            CHECK_STATUS(FMI1GetContinuousStates(instance, x, nx(S)));
+        }
         CHECK_STATUS(FMI1GetDerivatives(instance, dx, nx(S)));
 	} else if (isFMI2(S)) {
-        CHECK_STATUS(FMI2GetContinuousStates(instance, x, nx(S)));
+        if (readStates) {
+            CHECK_STATUS(FMI2GetContinuousStates(instance, x, nx(S)));
+        }
         CHECK_STATUS(FMI2GetDerivatives(instance, dx, nx(S)));
 	} else {
-        CHECK_STATUS(FMI3GetContinuousStates(instance, x, nx(S)));
+        if (readStates) {
+            CHECK_STATUS(FMI3GetContinuousStates(instance, x, nx(S)));
+        }
         CHECK_STATUS(FMI3GetContinuousStateDerivatives(instance, dx, nx(S)));
 	}
 }
 #endif
 
 
+#define MDL_JACOBIAN
+#if defined(MDL_JACOBIAN) && (defined(MATLAB_MEX_FILE) || defined(NRT))
+static void mdlJacobian(SimStruct *S) {
+
+	logDebug(S, "mdlJacobian(time=%.16g, majorTimeStep=%d)", ssGetT(S), ssIsMajorTimeStep(S));
+
+	void **p = ssGetPWork(S);
+
+	FMIInstance *instance = (FMIInstance *)p[0];
+	Jacobian *jacobian = (Jacobian *)p[10];
+
+	if (!jacobian) {
+		return;  // no analytic Jacobian
+	}
+
+	const time_T time = ssGetT(S);
+	real_T *x = ssGetContStates(S);
+
+	if (timeChanged(S, time)) {
+		CHECK_STATUS(FMI2SetTime(instance, time));
+	}
+
+	if (statesChanged(S, x)) {
+		CHECK_STATUS(FMI2SetContinuousStates(instance, x, nx(S)));
+	}
+
+	updateStateCache(S, time, x);
+
+	bool inputEvent;
+
+	CHECK_ERROR(setInput(S, true, false, &inputEvent));
+
+	// one directional derivative per color
+	CHECK_STATUS(FMIGetJacobian(instance, jacobian->coloring, jacobian->rowVRs, jacobian->columnVRs, ssGetJacobianPr(S)));
+}
+#endif
+
+
 static void mdlTerminate(SimStruct *S) {
 
+	const FMIStatus instantiationStatus = joinInstantiation(S);
+
+	if (instantiationStatus > FMIWarning) {
+		ssSetErrorStatus(S, "The FMU encountered an error.");
+	}
+
+	awaitStep(S);
+
 	logDebug(S, "mdlTerminate()");
 
 	void **p = ssGetPWork(S);
 
+#ifdef FMI_PIPELINED_CO_SIMULATION
+	freePipeline((Pipeline *)p[7]);
+	p[7] = NULL;
+#endif
+
 	FMIInstance *instance = (FMIInstance *)p[0];
 
     if (instance) {
@@ -2034,6 +3668,8 @@ static void mdlTerminate(SimStruct *S) {
 		    }
 	    }
 
+	    FMIFlushTrace(instance);
+
 	    FMIFreeInstance(instance);
     }
 
@@ -2043,6 +3679,21 @@ static void mdlTerminate(SimStruct *S) {
         free(preU);
     }
 
+    freeIOPlan((IOPlan *)p[4]);
+    p[4] = NULL;
+
+    freeBlockConfig((BlockConfig *)p[5]);
+    p[5] = NULL;
+
+    freeParameterSnapshot((ParameterSnapshot *)p[8]);
+    p[8] = NULL;
+
+    freeStateCache((StateCache *)p[9]);
+    p[9] = NULL;
+
+    freeJacobian((Jacobian *)p[10]);
+    p[10] = NULL;
+
 	FILE *logFile = (FILE *)p[1];
 
 		if (logFile) {
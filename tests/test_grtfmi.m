@@ -16,6 +16,17 @@ for fmi_version = [2 3]
   
   build_model('f14', fmi_version);
 
+  if strcmp(fmi_version, '2')
+    % FMI 2.0 FMUs of models with continuous states also support Model Exchange
+    assert(system('fmpy simulate f14.fmu --fmi-type ModelExchange --output-file f14_me_out.csv') == 0);
+    compare_results('f14_out.csv', 'f14_me_out.csv');
+
+    % integrate the continuous states with the variable-step solver
+    movefile('f14_out.csv', 'f14_fixed_step_out.csv');
+    build_model('f14', fmi_version, 'VariableStepSolver', 'on');
+    compare_results('f14_fixed_step_out.csv', 'f14_out.csv');
+  end
+
   build_model('sldemo_clutch', fmi_version);
 
   build_model('sldemo_fuelsys', fmi_version);
@@ -41,7 +52,7 @@ end
 end
 
 
-function build_model(model, fmi_version)
+function build_model(model, fmi_version, varargin)
 
 rwt_dir = fullfile(pwd, [model '_grt_fmi_rtw']);
 if exist(rwt_dir, 'dir')
@@ -78,6 +89,11 @@ set_param(h, 'GenerateReport', 'off');
 set_param(h, 'SignalLogging', 'off');
 set_param(h, 'Solver', 'ode3');
 
+% additional options of the target
+for i = 1:2:numel(varargin)
+    set_param(h, varargin{i}, varargin{i+1});
+end
+
 rtwbuild(h);
 
 close_system(h, 0);
@@ -87,3 +103,24 @@ assert(exist([model '.fmu'], 'file') == 2);
 assert(system(['fmpy simulate ' model '.fmu --output-file ' model '_out.csv']) == 0);
 
 end
+
+
+function compare_results(ref_file, out_file)
+% compare the outputs of a simulation with the reference (fixed-step Co-Simulation)
+
+ref = csvread(ref_file, 1);
+out = csvread(out_file, 1);
+
+assert(size(out, 2) == size(ref, 2), [out_file ' has different outputs than ' ref_file]);
+
+% interpolate at the time of the reference
+[t, i] = unique(out(:,1));
+out = interp1(t, out(i,2:end), ref(:,1), 'linear', 'extrap');
+ref = ref(:,2:end);
+
+% relative error (the discontinuities of the inputs may be detected at different times)
+rel_error = norm(out(:) - ref(:)) / max(norm(ref(:)), eps);
+
+assert(rel_error < 5e-2, sprintf('The relative error of %s is %g.', out_file, rel_error));
+
+end
@@ -0,0 +1,66 @@
+function test_jacobian
+% linearize an FMI 2.0 Model Exchange FMU with directional derivatives
+% (analytic Jacobian from mdlJacobian) and compare it with the numerical
+% perturbation and the analytic Jacobian of the Van der Pol oscillator
+
+version = '0.0.29';
+
+archive = ['Reference-FMUs-' version '.zip'];
+
+if ~exist(archive, 'file')
+    websave(archive, ['https://github.com/modelica/Reference-FMUs/releases/download/v' version '/' archive]);
+end
+
+unzip(archive, 'Reference-FMUs');
+
+fmu = fullfile(pwd, 'Reference-FMUs', '2.0', 'VanDerPol.fmu');
+
+md = FMIKit.getModelDescription(fmu);
+assert(md.modelExchange.providesDirectionalDerivative, ...
+    'VanDerPol.fmu does not provide directional derivatives')
+
+model = 'test_jacobian_vdp';
+
+if bdIsLoaded(model)
+    close_system(model, 0);
+end
+
+h = new_system(model);
+
+set_param(h, 'Solver', 'ode15s');
+
+block = [model '/FMU'];
+add_block('FMIKit_blocks/FMU', block);
+FMIKit.loadFMU(block, fmu);
+FMIKit.setInterfaceType(block, 'ModelExchange');
+
+% connect the outputs (x0, x1) to root outports
+ports = get_param(block, 'PortHandles');
+
+for i = 1:numel(ports.Outport)
+    outport = [model '/Out' num2str(i)];
+    add_block('simulink/Sinks/Out1', outport);
+    outport_ports = get_param(outport, 'PortHandles');
+    add_line(model, ports.Outport(i), outport_ports.Inport);
+end
+
+% operating point
+mu = 1;
+x = [1.5; -0.5];
+
+% analytic Jacobian (directional derivatives of the FMU)
+[A, ~, C, ~] = linmod(model, x, []);
+
+% numerical perturbation of the derivatives and outputs
+[A_fd, ~, C_fd, ~] = linmod(model, x, [], [1e-6 0], 'v5');
+
+close_system(h, 0);
+
+% der(x0) = x1, der(x1) = mu * (1 - x0^2) * x1 - x0
+A_ref = [0 1; -2 * mu * x(1) * x(2) - 1, mu * (1 - x(1)^2)];
+
+assert(max(abs(A(:) - A_fd(:))) < 1e-4, 'A does not match the finite differences')
+assert(max(abs(C(:) - C_fd(:))) < 1e-4, 'C does not match the finite differences')
+assert(max(abs(A(:) - A_ref(:))) < 1e-9, 'A does not match the analytic Jacobian')
+
+end